@@ -31,10 +31,13 @@
 #include <fcntl.h>
 #include <sys/param.h>
 #include <iconv.h>
+#include <langinfo.h>
+#include <string.h>
 
 #include "errors.h"
 #include "endianness.h"
 #include "fileio.h"
+#include "fatscan.h"
 #include "mallocv.h"
 
 // used to check if device is mounted
@@ -162,22 +165,19 @@ int32_t check_bootsector(struct sBootSector *bs) {
 	return 0;
 }
 
-int32_t read_bootsector(FILE *fd, struct sBootSector *bs) {
+int32_t read_bootsector(struct sFileIO *io, struct sBootSector *bs) {
 /*
 	reads bootsector
 */
 
-	assert(fd != NULL);
+	assert(io != NULL);
 	assert(bs != NULL);
 
-	// seek to beginning of fs
-	if (fs_seek(fd, 0, SEEK_SET) == -1) {
-		stderror();
-		return -1;
-	}
+	ssize_t n;
 
-	if (fs_read(bs, sizeof(struct sBootSector), 1, fd) < 1) {
-		if (feof(fd)) {
+	n=fs_readAt(io, bs, sizeof(struct sBootSector), 0);
+	if (n != sizeof(struct sBootSector)) {
+		if (n != -1) {
 			myerror("Boot sector is too short!");
 		} else {
 			myerror("Failed to read from file!");
@@ -198,28 +198,16 @@ int32_t writeBootSector(struct sFileSystem *fs) {
 	write boot sector
 */
 
-	// seek to beginning of fs
-	if (fs_seek(fs->fd, 0, SEEK_SET) == -1) {
-		stderror();
-		return -1;
-	}
-
 	// write boot sector
-	if (fs_write(&(fs->bs), sizeof(struct sBootSector), 1, fs->fd) < 1) {
+	if (fs_writeAt(&(fs->io), &(fs->bs), sizeof(struct sBootSector), 0) != sizeof(struct sBootSector)) {
 		stderror();
 		return -1;
 	}
 
 	//  update backup boot sector for FAT32 file systems
 	if (fs->FATType == FATTYPE_FAT32) {
-		// seek to beginning of backup boot sector
-		if (fs_seek(fs->fd, SwapInt16(fs->bs.FATxx.FAT32.BS_BkBootSec) * fs->sectorSize, SEEK_SET) == -1) {
-			stderror();
-			return -1;
-		}
-
-		// write backup boot sector
-		if (fs_write(&(fs->bs), sizeof(struct sBootSector), 1, fs->fd) < 1) {
+		if (fs_writeAt(&(fs->io), &(fs->bs), sizeof(struct sBootSector),
+				(off_t) SwapInt16(fs->bs.FATxx.FAT32.BS_BkBootSec) * fs->sectorSize) != sizeof(struct sBootSector)) {
 			stderror();
 			return -1;
 		}
@@ -236,13 +224,8 @@ int32_t readFSInfo(struct sFileSystem *fs, struct sFSInfo *fsInfo) {
 	assert(fs != NULL);
 	assert(fsInfo != NULL);
 
-	// seek to beginning of FSInfo structure
-	if (fs_seek(fs->fd, SwapInt16(fs->bs.FATxx.FAT32.BS_FSInfo) * fs->sectorSize, SEEK_SET) == -1) {
-		stderror();
-		return -1;
-	}
-
-	if (fs_read(fsInfo, sizeof(struct sFSInfo), 1, fs->fd) < 1) {
+	if (fs_readAt(&(fs->io), fsInfo, sizeof(struct sFSInfo),
+			(off_t) SwapInt16(fs->bs.FATxx.FAT32.BS_FSInfo) * fs->sectorSize) != sizeof(struct sFSInfo)) {
 		stderror();
 		return -1;
 	}
@@ -257,14 +240,9 @@ int32_t writeFSInfo(struct sFileSystem *fs, struct sFSInfo *fsInfo) {
 	assert(fs != NULL);
 	assert(fsInfo != NULL);
 
-	// seek to beginning of FSInfo structure
-	if (fs_seek(fs->fd, SwapInt16(fs->bs.FATxx.FAT32.BS_FSInfo) * fs->sectorSize, SEEK_SET) == -1) {
-		stderror();
-		return -1;
-	}
-
-	// write boot sector
-	if (fs_write(fsInfo, sizeof(struct sFSInfo), 1, fs->fd) < 1) {
+	// write FSInfo structure
+	if (fs_writeAt(&(fs->io), fsInfo, sizeof(struct sFSInfo),
+			(off_t) SwapInt16(fs->bs.FATxx.FAT32.BS_FSInfo) * fs->sectorSize) != sizeof(struct sFSInfo)) {
 		stderror();
 		return -1;
 	}
@@ -397,12 +375,7 @@ void *readFAT(struct sFileSystem *fs, u_int16_t nr) {
 		return NULL;
 	}
 	BSOffset = (off_t)SwapInt16(fs->bs.BS_RsvdSecCnt) * SwapInt16(fs->bs.BS_BytesPerSec);
-	if (fs_seek(fs->fd, BSOffset + nr * FATSizeInBytes, SEEK_SET) == -1) {
-		myerror("Seek error!");
-		free(FAT);
-		return NULL;
-	}
-	if (fs_read(FAT, FATSizeInBytes, 1, fs->fd) < 1) {
+	if (fs_readAt(&(fs->io), FAT, FATSizeInBytes, BSOffset + (off_t) nr * FATSizeInBytes) != FATSizeInBytes) {
 		myerror("Failed to read from file!");
 		free(FAT);
 		return NULL;
@@ -412,6 +385,49 @@ void *readFAT(struct sFileSystem *fs, u_int16_t nr) {
 
 }
 
+int32_t decodeFAT(struct sFileSystem *fs, const void *rawFAT) {
+/*
+	decodes a raw FAT into the in-memory FAT of the file system,
+	so that FAT entries can be looked up without any I/O
+*/
+
+	assert(fs != NULL);
+	assert(rawFAT != NULL);
+
+	u_int32_t FATSizeInBytes, entries;
+	const u_char *FAT = (const u_char *) rawFAT;
+
+	FATSizeInBytes = fs->FATSize * fs->sectorSize;
+
+	if (fs->FAT == NULL) {
+		if ((fs->FAT=malloc(((size_t) fs->clusters+2) * sizeof(u_int32_t)))==NULL) {
+			stderror();
+			return -1;
+		}
+	}
+	memset(fs->FAT, 0, ((size_t) fs->clusters+2) * sizeof(u_int32_t));
+
+	switch(fs->FATType) {
+	case FATTYPE_FAT32:
+		entries = MIN((u_int32_t) fs->clusters+2, FATSizeInBytes / 4);
+		decodeFAT32Entries(FAT, fs->FAT, entries);
+		break;
+	case FATTYPE_FAT16:
+		entries = MIN((u_int32_t) fs->clusters+2, FATSizeInBytes / 2);
+		decodeFAT16Entries(FAT, fs->FAT, entries);
+		break;
+	case FATTYPE_FAT12:
+		entries = MIN((u_int32_t) fs->clusters+2, (FATSizeInBytes - 1) * 2 / 3);
+		decodeFAT12Entries(FAT, fs->FAT, entries);
+		break;
+	default:
+		myerror("Failed to get FAT type!");
+		return -1;
+	}
+
+	return 0;
+}
+
 int32_t writeFAT(struct sFileSystem *fs, void *fat) {
 /*
 	write FAT to file system
@@ -422,21 +438,26 @@ int32_t writeFAT(struct sFileSystem *fs, void *fat) {
 
 	u_int32_t FATSizeInBytes, nr;
 	off_t BSOffset;
+	struct iovec iov[256];
 
 	FATSizeInBytes = fs->FATSize * fs->sectorSize;
 
 	BSOffset = (off_t)SwapInt16(fs->bs.BS_RsvdSecCnt) * SwapInt16(fs->bs.BS_BytesPerSec);
 
-	// write all FATs!
+	// write all FATs! They are stored back to back, so one vectored write does it
 	for(nr=0; nr< fs->bs.BS_NumFATs; nr++) {
-		if (fs_seek(fs->fd, BSOffset + nr * FATSizeInBytes, SEEK_SET) == -1) {
-			myerror("Seek error!");
-			return -1;
-		}
-		if (fs_write(fat, FATSizeInBytes, 1, fs->fd) < 1) {
-			myerror("Failed to read from file!");
-			return -1;
-		}
+		iov[nr].iov_base = fat;
+		iov[nr].iov_len = FATSizeInBytes;
+	}
+	if (fs_writevAt(&(fs->io), iov, fs->bs.BS_NumFATs, BSOffset) != (ssize_t) FATSizeInBytes * fs->bs.BS_NumFATs) {
+		myerror("Failed to write to file!");
+		return -1;
+	}
+
+	// keep in-memory FAT in sync with the file system
+	if (decodeFAT(fs, fat)) {
+		myerror("Failed to decode FAT!");
+		return -1;
 	}
 
 	return 0;
@@ -456,6 +477,7 @@ int32_t checkFATs(struct sFileSystem *fs) {
 	off_t BSOffset;
 
 	char *FAT1, *FATx;
+	const char *mapped;
 
 	// if there is just one FAT, we don't have to check anything
 	if (fs->bs.BS_NumFATs < 2) {
@@ -463,6 +485,16 @@ int32_t checkFATs(struct sFileSystem *fs) {
 	}
 
 	FATSizeInBytes = fs->FATSize * fs->sectorSize;
+	BSOffset = (off_t)SwapInt16(fs->bs.BS_RsvdSecCnt) * SwapInt16(fs->bs.BS_BytesPerSec);
+
+	// compare the FATs in place if the backend holds the device in memory
+	if ((mapped=fs_mapAt(&(fs->io), BSOffset, (size_t) fs->bs.BS_NumFATs * FATSizeInBytes)) != NULL) {
+		for(i=1; i < fs->bs.BS_NumFATs; i++) {
+			result = memcmp(mapped, mapped + (size_t) i * FATSizeInBytes, FATSizeInBytes) != 0;
+			if (result) break; // FATs don't match
+		}
+		return result;
+	}
 
 	if ((FAT1=malloc(FATSizeInBytes))==NULL) {
 		stderror();
@@ -473,14 +505,7 @@ int32_t checkFATs(struct sFileSystem *fs) {
 		free(FAT1);
 		return -1;
 	}
-	BSOffset = (off_t)SwapInt16(fs->bs.BS_RsvdSecCnt) * SwapInt16(fs->bs.BS_BytesPerSec);
-	if (fs_seek(fs->fd, BSOffset, SEEK_SET) == -1) {
-		myerror("Seek error!");
-		free(FAT1);
-		free(FATx);
-		return -1;
-	}
-	if (fs_read(FAT1, FATSizeInBytes, 1, fs->fd) < 1) {
+	if (fs_readAt(&(fs->io), FAT1, FATSizeInBytes, BSOffset) != FATSizeInBytes) {
 		myerror("Failed to read from file!");
 		free(FAT1);
 		free(FATx);
@@ -488,13 +513,7 @@ int32_t checkFATs(struct sFileSystem *fs) {
 	}
 
 	for(i=1; i < fs->bs.BS_NumFATs; i++) {
-		if (fs_seek(fs->fd, BSOffset+FATSizeInBytes, SEEK_SET) == -1) {
-			myerror("Seek error!");
-			free(FAT1);
-			free(FATx);
-			return -1;
-		}
-		if (fs_read(FATx, FATSizeInBytes, 1, fs->fd) < 1) {
+		if (fs_readAt(&(fs->io), FATx, FATSizeInBytes, BSOffset + (off_t) i * FATSizeInBytes) != FATSizeInBytes) {
 			myerror("Failed to read from file!");
 			free(FAT1);
 			free(FATx);
@@ -520,65 +539,18 @@ int32_t getFATEntry(struct sFileSystem *fs, u_int32_t cluster, u_int32_t *data)
 */
 
 	assert(fs != NULL);
+	assert(fs->FAT != NULL);
 	assert(data != NULL);
 
-	off_t FATOffset, BSOffset;
-
 	*data=0;
 
-	switch(fs->FATType) {
-	case FATTYPE_FAT32:
-		FATOffset = (off_t)cluster * 4;
-		BSOffset = (off_t)SwapInt16(fs->bs.BS_RsvdSecCnt) * SwapInt16(fs->bs.BS_BytesPerSec) + FATOffset;
-		if (fs_seek(fs->fd, BSOffset, SEEK_SET) == -1) {
-			myerror("Seek error!");
-			return -1;
-		}
-		if (fs_read(data, 4, 1, fs->fd) < 1) {
-			myerror("Failed to read from file!");
-			return -1;
-		}
-		*data=SwapInt32(*data);
-		*data = *data & 0x0fffffff;
-		break;
-	case FATTYPE_FAT16:
-		FATOffset = (off_t)cluster * 2;
-		BSOffset = (off_t) SwapInt16(fs->bs.BS_RsvdSecCnt) * SwapInt16(fs->bs.BS_BytesPerSec) + FATOffset;
-		if (fs_seek(fs->fd, BSOffset, SEEK_SET) == -1) {
-			myerror("Seek error!");
-			return -1;
-		}
-		if (fs_read(data, 2, 1, fs->fd)<1) {
-			myerror("Failed to read from file!");
-			return -1;
-		}
-		*data=SwapInt32(*data);
-		break;
-	case FATTYPE_FAT12:
-		FATOffset = (off_t) cluster + (cluster / 2);
-		BSOffset = (off_t) SwapInt16(fs->bs.BS_RsvdSecCnt) * SwapInt16(fs->bs.BS_BytesPerSec) + FATOffset;
-		if (fs_seek(fs->fd, BSOffset, SEEK_SET) == -1) {
-			myerror("Seek error!");
-			return -1;
-		}
-		if (fs_read(data, 2, 1, fs->fd)<1) {
-			myerror("Failed to read from file!");
-			return -1;
-		}
-
-		*data=SwapInt32(*data);
-
-		if (cluster & 1)  {
-			*data = *data >> 4;	/* cluster number is odd */
-		} else {
-			*data = *data & 0x0FFF;	/* cluster number is even */
-		}
-		break;
-	default:
-		myerror("Failed to get FAT type!");
+	if (cluster >= (u_int32_t) fs->clusters+2) {
+		myerror("Cluster %08x does not exist!", cluster);
 		return -1;
 	}
 
+	*data=fs->FAT[cluster];
+
 	return 0;
 
 }
@@ -602,18 +574,14 @@ void *readCluster(struct sFileSystem *fs, u_int32_t cluster) {
 */
 	void *dummy;
 
-	if (fs_seek(fs->fd, getClusterOffset(fs, cluster), SEEK_SET) != 0) {
-		stderror();
-		return NULL;
-	}
-
 	if ((dummy = malloc(fs->clusterSize)) == NULL) {
 		stderror();
 		return NULL;
 	}
 
-	if ((fs_read(dummy, fs->clusterSize, 1, fs->fd)<1)) {
+	if (fs_readAt(&(fs->io), dummy, fs->clusterSize, getClusterOffset(fs, cluster)) != fs->clusterSize) {
 		myerror("Failed to read cluster!");
+		free(dummy);
 		return NULL;
 	}
 
@@ -624,12 +592,7 @@ int32_t writeCluster(struct sFileSystem *fs, u_int32_t cluster, void *data) {
 /*
 	write cluster to file systen
 */
-	if (fs_seek(fs->fd, getClusterOffset(fs, cluster), SEEK_SET) != 0) {
-		stderror();
-		return -1;
-	}
-
-	if (fs_write(data, fs->clusterSize, 1, fs->fd)<1) {
+	if (fs_writeAt(&(fs->io), data, fs->clusterSize, getClusterOffset(fs, cluster)) != fs->clusterSize) {
 		stderror();
 		return -1;
 	}
@@ -637,27 +600,6 @@ int32_t writeCluster(struct sFileSystem *fs, u_int32_t cluster, void *data) {
 	return 0;
 }
 
-int32_t parseEntry(struct sFileSystem *fs, union sDirEntry *de) {
-/*
-	parses one directory entry
-*/
-
-	assert(fs != NULL);
-	assert(de != NULL);
-
-	if ((fs_read(de, DIR_ENTRY_SIZE, 1, fs->fd)<1)) {
-		myerror("Failed to read from file!");
-		return -1;
-	}
-
-	if (de->ShortDirEntry.DIR_Name[0] == DE_FOLLOWING_FREE ) return 0; // no more entries
-
-	// long dir entry
-	if ((de->LongDirEntry.LDIR_Attr & ATTR_LONG_NAME_MASK) == ATTR_LONG_NAME) return 2;
-
-	return 1; // short dir entry
-}
-
 u_char calculateChecksum (char *sname) {
 	u_char len;
 	u_char sum;
@@ -670,29 +612,30 @@ u_char calculateChecksum (char *sname) {
 }
 
 
-int32_t openFileSystem(char *path, u_int32_t mode, struct sFileSystem *fs) {
+int32_t openFileSystem(char *path, u_int32_t mode, const struct sIOBackend *backend, struct sFileSystem *fs) {
 /*
-	opens file system and assemlbes file system information into data structure
+	opens file system with the I/O backend and assemlbes file system information into data structure
 */
 	assert(path != NULL);
+	assert(backend != NULL);
 	assert(fs != NULL);
 
-	int32_t ret;
+	int32_t ret, fd, flags;
+	u_int16_t activeFAT;
+	off_t FATOffset, dataOffset;
+	void *rawFAT;
+	const void *mappedFAT;
 
-	fs->rfd=0;
+	fs->mode=mode;
+	fs->FAT=NULL;
+	fs->clusterBitmap=NULL;
 
 	switch(mode) {
 		case FS_MODE_RO:
-			if ((fs->fd=fopen(path, "rb")) == NULL) {
-				stderror();
-				return -1;
-			}			
+			flags=O_RDONLY;
 			break;
 		case FS_MODE_RW:
-			if ((fs->fd=fopen(path, "r+b")) == NULL) {
-				stderror();
-				return -1;
-			}
+			flags=O_RDWR;
 			break;
 		case FS_MODE_RO_EXCL:
 		case FS_MODE_RW_EXCL:
@@ -711,28 +654,29 @@ int32_t openFileSystem(char *path, u_int32_t mode, struct sFileSystem *fs) {
 			}
 
 			// opens the device exclusively. This is not mandatory! e.g. mkfs.vfat ignores it!
-			if ((fs->rfd=open(path, (mode == FS_MODE_RO_EXCL) ? O_RDONLY | O_EXCL : O_RDWR | O_EXCL)) == -1) {
-				stderror();
-				return -1;
-			}
-
-			// connect the file descriptor to a stream
-			if ((fs->fd=fdopen(fs->rfd, (mode == FS_MODE_RO_EXCL) ? "rb" : "r+b")) == NULL) {
-				stderror();
-				close(fs->rfd);
-				return -1;
-			}
+			flags=((mode == FS_MODE_RO_EXCL) ? O_RDONLY : O_RDWR) | O_EXCL;
 			break;
 		default:
 			myerror("Mode not supported!");
 			return -1;
 	}
 
+	if ((fd=open(path, flags)) == -1) {
+		stderror();
+		return -1;
+	}
+
+	// the backend owns the file descriptor from now on
+	if (fs_open(&(fs->io), backend, fd, (mode == FS_MODE_RW) || (mode == FS_MODE_RW_EXCL))) {
+		myerror("Failed to open file system with I/O backend \"%s\"!", backend->name);
+		close(fd);
+		return -1;
+	}
+
 	// read boot sector
-	if (read_bootsector(fs->fd, &(fs->bs))) {
+	if (read_bootsector(&(fs->io), &(fs->bs))) {
 		myerror("Failed to read boot sector!");
-		fs_close(fs->fd);
-		close(fs->rfd);
+		fs_close(&(fs->io));
 		return -1;
 	}
 
@@ -748,28 +692,24 @@ int32_t openFileSystem(char *path, u_int32_t mode, struct sFileSystem *fs) {
 
 	if (fs->totalSectors == 0) {
 		myerror("Count of total sectors must not be zero!");
-		fs_close(fs->fd);
-		close(fs->rfd);
+		fs_close(&(fs->io));
 		return -1;
 	}
 
 	fs->FATType = getFATType(&(fs->bs));
 	if (fs->FATType == -1) {
 		myerror("Failed to get FAT type!");
-		fs_close(fs->fd);
-		close(fs->rfd);
+		fs_close(&(fs->io));
 		return -1;
 	}
 
 	if ((fs->FATType == FATTYPE_FAT32) && (fs->bs.FATxx.FAT32.BS_FATSz32 == 0)) {
 		myerror("32-bit count of FAT sectors must not be zero for FAT32!");
-		fs_close(fs->fd);
-		close(fs->rfd);
+		fs_close(&(fs->io));
 		return -1;
 	} else 	if (((fs->FATType == FATTYPE_FAT12) || (fs->FATType == FATTYPE_FAT16)) && (fs->bs.BS_FATSz16 == 0)) {
 		myerror("16-bit count of FAT sectors must not be zero for FAT1x!");
-		fs_close(fs->fd);
-		close(fs->rfd);
+		fs_close(&(fs->io));
 		return -1;
 	}	
 
@@ -782,28 +722,24 @@ int32_t openFileSystem(char *path, u_int32_t mode, struct sFileSystem *fs) {
 	// check whether count of root dir entries is ok for given FAT type
 	if (((fs->FATType == FATTYPE_FAT16) || (fs->FATType == FATTYPE_FAT12)) && (SwapInt16(fs->bs.BS_RootEntCnt) == 0)) {
 		myerror("Count of root directory entries must not be zero for FAT1x!");
-		fs_close(fs->fd);
-		close(fs->rfd);
+		fs_close(&(fs->io));
 		return -1;	
 	} else 	if ((fs->FATType == FATTYPE_FAT32) && (SwapInt16(fs->bs.BS_RootEntCnt) != 0)) {
 		myerror("Count of root directory entries must be zero for FAT32 (%u)!", SwapInt16(fs->bs.BS_RootEntCnt));
-		fs_close(fs->fd);
-		close(fs->rfd);
+		fs_close(&(fs->io));
 		return -1;	
 	}
 
 	fs->clusters=getCountOfClusters(&(fs->bs));
 	if (fs->clusters == -1) {
 		myerror("Failed to get count of clusters!");
-		fs_close(fs->fd);
-		close(fs->rfd);
+		fs_close(&(fs->io));
 		return -1;
 	}
 
 	if (fs->clusters > 268435445) {
 		myerror("Count of clusters should be less than 268435446, but is %d!", fs->clusters);
-		fs_close(fs->fd);
-		close(fs->rfd);
+		fs_close(&(fs->io));
 		return -1;
 	}
 
@@ -824,30 +760,83 @@ int32_t openFileSystem(char *path, u_int32_t mode, struct sFileSystem *fs) {
 	fs->firstDataSector = (SwapInt16(fs->bs.BS_RsvdSecCnt) +
 			      (fs->bs.BS_NumFATs * fs->FATSize) + rootDirSectors);
 
+	// FAT32 may disable mirroring and use just one active FAT (bit 7 and bits 0-3 of BS_ExtFlags)
+	activeFAT=0;
+	if ((fs->FATType == FATTYPE_FAT32) && (SwapInt16(fs->bs.FATxx.FAT32.BS_ExtFlags) & 0x80) &&
+	    ((SwapInt16(fs->bs.FATxx.FAT32.BS_ExtFlags) & 0x0f) < fs->bs.BS_NumFATs)) {
+		activeFAT = SwapInt16(fs->bs.FATxx.FAT32.BS_ExtFlags) & 0x0f;
+	}
+
+	// the FATs and the FAT1x root directory are read front to back, the data region piecemeal
+	FATOffset = (off_t) SwapInt16(fs->bs.BS_RsvdSecCnt) * fs->sectorSize;
+	dataOffset = (off_t) fs->firstDataSector * fs->sectorSize;
+	fs_advise(&(fs->io), FATOffset, dataOffset - FATOffset, IO_ACCESS_SEQUENTIAL);
+	if (fs->io.size > dataOffset) {
+		fs_advise(&(fs->io), dataOffset, fs->io.size - dataOffset, IO_ACCESS_RANDOM);
+	}
+
+	// keep a decoded copy of the active FAT in memory,
+	// it is decoded straight from the device if the backend holds it in memory
+	mappedFAT=fs_mapAt(&(fs->io), FATOffset + (off_t) activeFAT * fs->FATSize * fs->sectorSize,
+		(size_t) fs->FATSize * fs->sectorSize);
+	if (mappedFAT != NULL) {
+		rawFAT=NULL;
+	} else if ((rawFAT=readFAT(fs, activeFAT)) == NULL) {
+		myerror("Failed to read FAT!");
+		fs_close(&(fs->io));
+		return -1;
+	}
+	if (decodeFAT(fs, (mappedFAT != NULL) ? mappedFAT : rawFAT)) {
+		myerror("Failed to decode FAT!");
+		free(rawFAT);
+		fs_close(&(fs->io));
+		return -1;
+	}
+	free(rawFAT);
+
+	// bitmap for loop detection in cluster chains
+	if ((fs->clusterBitmap=malloc(((size_t) fs->clusters+2+7) / 8)) == NULL) {
+		stderror();
+		free(fs->FAT);
+		fs_close(&(fs->io));
+		return -1;
+	}
+	memset(fs->clusterBitmap, 0, ((size_t) fs->clusters+2+7) / 8);
+
 	// convert utf 16 le to local charset
         fs->cd = iconv_open("//TRANSLIT", "UTF-16LE");
         if (fs->cd == (iconv_t)-1) {
                 myerror("iconv_open failed!");
+		free(fs->clusterBitmap);
+		free(fs->FAT);
+		fs_close(&(fs->io));
 		return -1;
         }
+	// the built-in decoder is used if the local charset is UTF-8 anyway
+	fs->utf8Names = (strcmp(nl_langinfo(CODESET), "UTF-8") == 0);
 
 	return 0;
 }
 
+int32_t flushFileSystem(struct sFileSystem *fs) {
+/*
+	flush buffered writes to the operating system
+*/
+	return fs_flush(&(fs->io));
+}
+
+int32_t writebackFileSystem(struct sFileSystem *fs) {
+/*
+	flush buffered writes and start writeback to the device without waiting for it
+*/
+	return fs_sync(&(fs->io), 0);
+}
+
 int32_t syncFileSystem(struct sFileSystem *fs) {
 /*
 	sync file system
 */
-	if (fflush(fs->fd) != 0) {
-		myerror("Could not flush stream!");
-		return -1;
-	}
-	if (fsync(fileno(fs->fd)) != 0) {
-		myerror("Could not sync file descriptor!");
-		return -1;
-	}
-
-	return 0;
+	return fs_sync(&(fs->io), 1);
 }
 
 int32_t closeFileSystem(struct sFileSystem *fs) {
@@ -856,10 +845,12 @@ int32_t closeFileSystem(struct sFileSystem *fs) {
 */
 	assert(fs != NULL);
 
-	fs_close(fs->fd);
-	if ((fs->mode == FS_MODE_RW_EXCL) || (fs->mode == FS_MODE_RO_EXCL))
-		close(fs->rfd);
+	fs_close(&(fs->io));
 	iconv_close(fs->cd);
+	free(fs->FAT);
+	fs->FAT=NULL;
+	free(fs->clusterBitmap);
+	fs->clusterBitmap=NULL;
 
 	return 0;
 }
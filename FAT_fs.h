@@ -50,6 +50,8 @@
 #define DE_FREE 0xe5
 #define DE_FOLLOWING_FREE 0x00
 #define LAST_LONG_ENTRY 0x40
+#define MAX_LONG_DIR_ENTRIES 63		// a long name has at most 63 long dir entries
+#define LDIR_NAME_BYTES 26		// UTF-16LE name bytes of one long dir entry
 
 #define DIR_ENTRY_SIZE 32
 
@@ -68,6 +70,7 @@
 #include <iconv.h>
 
 #include "platform.h"
+#include "fileio.h"
 
 // Directory entry structures
 // Structure for long directory names
@@ -171,8 +174,7 @@ struct sFSInfo {
 
 // holds information about the file system
 struct sFileSystem {
-	FILE *fd;
-	int32_t rfd;
+	struct sFileIO io;
 	u_int32_t mode;
 	char path[MAX_PATH_LEN+1];
 	struct sBootSector bs;
@@ -187,17 +189,26 @@ struct sFileSystem {
 	u_int32_t maxDirEntriesPerCluster;
 	u_int32_t maxClusterChainLength;
 	u_int32_t firstDataSector;
+	u_int32_t *FAT;			// decoded copy of the active FAT
+	u_int8_t *clusterBitmap;	// one bit per cluster for loop detection in cluster chains
 	iconv_t cd;
+	u_int32_t utf8Names;		// long names are decoded by utf16leToUTF8 instead of iconv
 };
 
 // functions
 
-// opens file system and calculates file system information
-int32_t openFileSystem(char *path, u_int32_t mode, struct sFileSystem *fs);
+// opens file system with the I/O backend and calculates file system information
+int32_t openFileSystem(char *path, u_int32_t mode, const struct sIOBackend *backend, struct sFileSystem *fs);
 
 // update boot sector
 int32_t writeBootSector(struct sFileSystem *fs);
 
+// flush buffered writes to the operating system
+int32_t flushFileSystem(struct sFileSystem *fs);
+
+// flush buffered writes and start writeback to the device without waiting for it
+int32_t writebackFileSystem(struct sFileSystem *fs);
+
 // sync file system
 int32_t syncFileSystem(struct sFileSystem *fs);
 
@@ -213,6 +224,9 @@ int32_t getFATEntry(struct sFileSystem *fs, u_int32_t cluster, u_int32_t *data);
 // read FAT from file system
 void *readFAT(struct sFileSystem *fs, u_int16_t nr);
 
+// decode raw FAT into the in-memory FAT of the file system
+int32_t decodeFAT(struct sFileSystem *fs, const void *rawFAT);
+
 // write FAT to file system
 int32_t writeFAT(struct sFileSystem *fs, void *fat);
 
@@ -234,9 +248,6 @@ u_int16_t isBadCluster(struct sFileSystem *fs, const u_int32_t data);
 // returns the offset of a specific cluster in the data region of the file system
 off_t getClusterOffset(struct sFileSystem *fs, u_int32_t cluster);
 
-// parses one directory entry
-int32_t parseEntry(struct sFileSystem *fs, union sDirEntry *de);
-
 // calculate checksum for short dir entry name
 u_char calculateChecksum (char *sname);
 
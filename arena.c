@@ -0,0 +1,136 @@
+/*
+	FATSort, utility for sorting FAT directory structures
+	Copyright (C) 2004 Boris Leidner <fatsort(at)formenos.de>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+	This file contains/describes an arena allocator. Memory is taken from
+	large blocks and released all at once when the arena is freed.
+*/
+
+#include "arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include "errors.h"
+#include "mallocv.h"
+
+// alignment of allocations
+#define ARENA_ALIGN 16
+#define ALIGN_UP(x) (((x) + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1))
+
+// block data starts after the aligned header
+#define BLOCK_DATA(b) ((char *) (b) + ALIGN_UP(sizeof(struct sArenaBlock)))
+
+struct sArenaBlock *newArenaBlock(size_t size) {
+/*
+	create a new arena block with size usable bytes
+*/
+	struct sArenaBlock *block;
+
+	if ((block=malloc(ALIGN_UP(sizeof(struct sArenaBlock)) + size)) == NULL) {
+		stderror();
+		return NULL;
+	}
+	block->next=NULL;
+	block->size=size;
+	block->used=0;
+
+	return block;
+}
+
+struct sArena *newArena(void) {
+/*
+	create a new arena
+*/
+	struct sArena *arena;
+
+	if ((arena=malloc(sizeof(struct sArena))) == NULL) {
+		stderror();
+		return NULL;
+	}
+	if ((arena->blocks=newArenaBlock(ARENA_BLOCK_SIZE)) == NULL) {
+		free(arena);
+		return NULL;
+	}
+
+	return arena;
+}
+
+void *arenaAlloc(struct sArena *arena, size_t size) {
+/*
+	allocate size bytes from arena
+*/
+	assert(arena != NULL);
+	assert(arena->blocks != NULL);
+
+	struct sArenaBlock *block=arena->blocks;
+	void *ptr;
+
+	size=ALIGN_UP(size);
+
+	if (block->size - block->used < size) {
+		if (size > ARENA_BLOCK_SIZE / 4) {
+			// large allocations get their own block behind the current one
+			if ((block=newArenaBlock(size)) == NULL) return NULL;
+			block->next=arena->blocks->next;
+			arena->blocks->next=block;
+		} else {
+			if ((block=newArenaBlock(ARENA_BLOCK_SIZE)) == NULL) return NULL;
+			block->next=arena->blocks;
+			arena->blocks=block;
+		}
+	}
+
+	ptr=BLOCK_DATA(block) + block->used;
+	block->used+=size;
+
+	return ptr;
+}
+
+char *arenaStrdup(struct sArena *arena, const char *str) {
+/*
+	copy string into arena
+*/
+	assert(arena != NULL);
+	assert(str != NULL);
+
+	size_t len=strlen(str)+1;
+	char *new;
+
+	if ((new=arenaAlloc(arena, len)) == NULL) return NULL;
+	memcpy(new, str, len);
+
+	return new;
+}
+
+void freeArena(struct sArena *arena) {
+/*
+	free arena and all memory allocated from it
+*/
+	assert(arena != NULL);
+
+	struct sArenaBlock *block, *next;
+
+	for (block=arena->blocks; block != NULL; block=next) {
+		next=block->next;
+		free(block);
+	}
+	free(arena);
+}
@@ -0,0 +1,61 @@
+/*
+	FATSort, utility for sorting FAT directory structures
+	Copyright (C) 2004 Boris Leidner <fatsort(at)formenos.de>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+	This file contains/describes an arena allocator. Memory is taken from
+	large blocks and released all at once when the arena is freed.
+*/
+
+#ifndef __arena_h__
+#define __arena_h__
+
+#include <stddef.h>
+
+// size of a regular arena block
+#define ARENA_BLOCK_SIZE 65536
+
+struct sArenaBlock {
+/*
+	block of arena memory, data follows the header
+*/
+	struct sArenaBlock *next;
+	size_t size;			// usable size of block
+	size_t used;			// used bytes of block
+};
+
+struct sArena {
+/*
+	arena with list of blocks, the current block comes first
+*/
+	struct sArenaBlock *blocks;
+};
+
+// create a new arena
+struct sArena *newArena(void);
+
+// allocate size bytes from arena
+void *arenaAlloc(struct sArena *arena, size_t size);
+
+// copy string into arena
+char *arenaStrdup(struct sArena *arena, const char *str);
+
+// free arena and all memory allocated from it
+void freeArena(struct sArena *arena);
+
+#endif // __arena_h__
@@ -19,9 +19,9 @@
 
 /*
 	This file contains/describes the cluster chain ADO with its structures and
-	functions. Cluster chain ADOs hold a linked list of cluster numbers.
-	Together all clusters in a cluster chain hold the date of a file or a
-	directory in a FAT filesystem.
+	functions. Cluster chain ADOs hold an array of runs of consecutive cluster
+	numbers. Together all clusters in a cluster chain hold the date of a file
+	or a directory in a FAT filesystem.
 */
 
 #include "clusterchain.h"
@@ -32,9 +32,10 @@
 #include "errors.h"
 #include "mallocv.h"
 
-// const struct sClusterChain __INITCLUSTERCHAIN__ = {0, NULL};
+// initial number of runs allocated for a cluster chain
+#define INITIAL_RUNS 4
 
-struct sClusterChain *newClusterChain(void) {
+struct sClusterChain *newClusterChain(u_int8_t *visited) {
 /*
 	create new cluster chain
 */
@@ -44,35 +45,72 @@ struct sClusterChain *newClusterChain(void) {
 		stderror();
 		return NULL;
 	}
-	tmp->cluster=0;
-	tmp->next=NULL;
+	if ((tmp->runs=malloc(INITIAL_RUNS * sizeof(struct sClusterRun)))==NULL) {
+		stderror();
+		free(tmp);
+		return NULL;
+	}
+	tmp->runCount=0;
+	tmp->maxRuns=INITIAL_RUNS;
+	tmp->clusterCount=0;
+	tmp->visited=visited;
 	return tmp;
 }
 
 int32_t insertCluster(struct sClusterChain *chain, u_int32_t cluster) {
 /*
-	allocate memory and insert cluster into cluster chain
+	append cluster to cluster chain
 */
 	assert(chain != NULL);
 
-	while (chain->next != NULL) {
-		if (chain->cluster == cluster) {
-			myerror("Loop in cluster chain detected (%08lx)!", cluster);
-			return -1;
-		}
-		chain=chain->next;
-	}
+	struct sClusterRun *run, *tmp;
 
-	if  ((chain->next = malloc(sizeof(struct sClusterChain))) == NULL) {
-		stderror();
+	if ((chain->visited != NULL) && (chain->visited[cluster / 8] & (1 << (cluster % 8)))) {
+		myerror("Loop in cluster chain detected (%08lx)!", cluster);
 		return -1;
 	}
-	chain->next->cluster=cluster;
-	chain->next->next=NULL;
-	
+
+	run=(chain->runCount != 0) ? &(chain->runs[chain->runCount-1]) : NULL;
+
+	// extend last run if cluster follows it directly, otherwise start a new run
+	if ((run != NULL) && (run->start + run->length == cluster)) {
+		run->length++;
+	} else {
+		if (chain->runCount == chain->maxRuns) {
+			if ((tmp=realloc(chain->runs, chain->maxRuns * 2 * sizeof(struct sClusterRun)))==NULL) {
+				stderror();
+				return -1;
+			}
+			chain->runs=tmp;
+			chain->maxRuns*=2;
+		}
+		chain->runs[chain->runCount].start=cluster;
+		chain->runs[chain->runCount].length=1;
+		chain->runCount++;
+	}
+	chain->clusterCount++;
+
+	if (chain->visited != NULL) chain->visited[cluster / 8] |= (1 << (cluster % 8));
+
 	return 0;
 }
 
+u_int32_t getClusterAt(struct sClusterChain *chain, u_int32_t index) {
+/*
+	returns the cluster at position index of the cluster chain
+*/
+	assert(chain != NULL);
+	assert(index < chain->clusterCount);
+
+	u_int32_t i;
+
+	for (i=0; index >= chain->runs[i].length; i++) {
+		index-=chain->runs[i].length;
+	}
+
+	return chain->runs[i].start + index;
+}
+
 void freeClusterChain(struct sClusterChain *chain) {
 /*
 	free cluster chain
@@ -80,12 +118,18 @@ void freeClusterChain(struct sClusterChain *chain) {
 
 	assert(chain != NULL);
 
-	struct sClusterChain *tmp;
-	
-	while(chain != NULL) {
-		tmp=chain;
-		chain=chain->next;
-		free(tmp);
+	u_int32_t i, cluster;
+
+	// release clusters in bitmap, so it can be used for the next chain
+	if (chain->visited != NULL) {
+		for (i=0; i<chain->runCount; i++) {
+			for (cluster=chain->runs[i].start; cluster < chain->runs[i].start + chain->runs[i].length; cluster++) {
+				chain->visited[cluster / 8] &= ~(1 << (cluster % 8));
+			}
+		}
 	}
 
+	free(chain->runs);
+	free(chain);
+
 }
@@ -19,9 +19,9 @@
 
 /*
 	This file contains/describes the cluster chain ADO with its structures and
-	functions. Cluster chain ADOs hold a linked list of cluster numbers.
-	Together all clusters in a cluster chain hold the date of a file or a
-	directory in a FAT filesystem.
+	functions. Cluster chain ADOs hold an array of runs of consecutive cluster
+	numbers. Together all clusters in a cluster chain hold the date of a file
+	or a directory in a FAT filesystem.
 */
 
 #ifndef __clusterchain_h__
@@ -31,20 +31,34 @@
 
 #include "platform.h"
 
+struct sClusterRun {
+/*
+	this structure contains a run of consecutive clusters
+*/
+	u_int32_t start;
+	u_int32_t length;
+};
+
 struct sClusterChain {
 /*
 	this structure contains cluster chains
 */
-	u_int32_t cluster;
-	struct sClusterChain *next;
+	struct sClusterRun *runs;	// runs of consecutive clusters
+	u_int32_t runCount;		// number of runs in use
+	u_int32_t maxRuns;		// number of allocated runs
+	u_int32_t clusterCount;		// number of clusters in chain
+	u_int8_t *visited;		// bitmap of clusters for loop detection (may be NULL)
 };
 
-// create new cluster chain
-struct sClusterChain *newClusterChain(void);
+// create new cluster chain, visited is an optional zeroed bitmap with one bit per cluster
+struct sClusterChain *newClusterChain(u_int8_t *visited);
 
-// allocate memory and insert cluster into cluster chain
+// append cluster to cluster chain
 int32_t insertCluster(struct sClusterChain *chain, u_int32_t cluster);
 
+// returns the cluster at position index of the cluster chain
+u_int32_t getClusterAt(struct sClusterChain *chain, u_int32_t index);
+
 // free cluster chain
 void freeClusterChain(struct sClusterChain *chain);
 
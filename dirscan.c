@@ -0,0 +1,231 @@
+/*
+	FATSort, utility for sorting FAT directory structures
+	Copyright (C) 2004 Boris Leidner <fatsort(at)formenos.de>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+	This file contains/describes functions for the classification of
+	directory entries in blocks.
+*/
+
+#include "dirscan.h"
+
+#include <string.h>
+#include <assert.h>
+#ifdef HAVE_X86_KERNELS
+#include <immintrin.h>
+#endif
+#include "mallocv.h"
+
+#ifdef HAVE_X86_KERNELS
+// the transposition leaves byte c of the entries in vector COLUMN[c] (c with reversed bits)
+static const u_int32_t COLUMN[16]={0, 8, 4, 12, 2, 10, 6, 14, 1, 9, 5, 13, 3, 11, 7, 15};
+#define NAME0 COLUMN[0]
+#define ATTR COLUMN[11]
+#endif
+
+void (*classifyDirEntries)(const union sDirEntry *de, u_int32_t n, struct sDirEntryClass *cls) = classifyDirEntriesScalar;
+
+static void clearClass(struct sDirEntryClass *cls) {
+/*
+	clears the masks of a classification
+*/
+	cls->end=0;
+	cls->deleted=0;
+	cls->longName=0;
+	cls->shortName=0;
+	cls->volumeLabel=0;
+}
+
+static void classifyScalar(const union sDirEntry *de, u_int32_t first, u_int32_t n, struct sDirEntryClass *cls) {
+/*
+	classifies the dir entries first to n-1 one by one
+*/
+	u_int32_t i;
+	u_int64_t bit;
+	u_char name0, attr;
+
+	for (i=first; i<n; i++) {
+		bit=(u_int64_t) 1 << i;
+		name0=(u_char) de[i].ShortDirEntry.DIR_Name[0];
+		attr=de[i].ShortDirEntry.DIR_Atrr;
+
+		if (name0 == DE_FOLLOWING_FREE) {
+			cls->end|=bit;
+		} else if ((attr & ATTR_LONG_NAME_MASK) == ATTR_LONG_NAME) {
+			cls->longName|=bit;
+		} else {
+			cls->shortName|=bit;
+			if (attr & ATTR_VOLUME_ID) cls->volumeLabel|=bit;
+		}
+		if (name0 == DE_FREE) cls->deleted|=bit;
+
+		cls->checksum[i]=calculateChecksum((char *) de[i].ShortDirEntry.DIR_Name);
+	}
+}
+
+#ifdef HAVE_X86_KERNELS
+TARGET_SSE2 static void classifySSE2(const union sDirEntry *de, u_int32_t first, struct sDirEntryClass *cls) {
+/*
+	classifies the 16 dir entries starting at first. The first 16 bytes of
+	the entries are transposed, so that one vector holds the same byte of all entries.
+*/
+	__m128i a[16], b[16];
+	__m128i sum, end, longName;
+	u_int32_t k, endBits, longBits;
+
+	for (k=0; k<16; k++) a[k]=_mm_loadu_si128((const __m128i *) &de[first+k]);
+
+	for (k=0; k<8; k++) {
+		b[k]=_mm_unpacklo_epi8(a[2*k], a[2*k+1]);
+		b[k+8]=_mm_unpackhi_epi8(a[2*k], a[2*k+1]);
+	}
+	for (k=0; k<8; k++) {
+		a[k]=_mm_unpacklo_epi16(b[2*k], b[2*k+1]);
+		a[k+8]=_mm_unpackhi_epi16(b[2*k], b[2*k+1]);
+	}
+	for (k=0; k<8; k++) {
+		b[k]=_mm_unpacklo_epi32(a[2*k], a[2*k+1]);
+		b[k+8]=_mm_unpackhi_epi32(a[2*k], a[2*k+1]);
+	}
+	for (k=0; k<8; k++) {
+		a[k]=_mm_unpacklo_epi64(b[2*k], b[2*k+1]);
+		a[k+8]=_mm_unpackhi_epi64(b[2*k], b[2*k+1]);
+	}
+
+	end=_mm_cmpeq_epi8(a[NAME0], _mm_setzero_si128());
+	longName=_mm_cmpeq_epi8(_mm_and_si128(a[ATTR], _mm_set1_epi8(ATTR_LONG_NAME_MASK)), _mm_set1_epi8(ATTR_LONG_NAME));
+	endBits=_mm_movemask_epi8(end);
+	longBits=_mm_movemask_epi8(longName) & ~endBits;
+
+	cls->end|=(u_int64_t) endBits << first;
+	cls->longName|=(u_int64_t) longBits << first;
+	cls->shortName|=(u_int64_t) (~(endBits | longBits) & 0xffff) << first;
+	cls->deleted|=(u_int64_t) _mm_movemask_epi8(_mm_cmpeq_epi8(a[NAME0], _mm_set1_epi8((char) DE_FREE))) << first;
+	cls->volumeLabel|=(u_int64_t) (_mm_movemask_epi8(_mm_cmpeq_epi8(
+		_mm_and_si128(a[ATTR], _mm_set1_epi8(ATTR_VOLUME_ID)), _mm_set1_epi8(ATTR_VOLUME_ID))) &
+		~(endBits | longBits) & 0xffff) << first;
+
+	// checksums of all 16 short names side by side, the byte rotation is done with 16 bit shifts
+	sum=_mm_setzero_si128();
+	for (k=0; k<11; k++) {
+		sum=_mm_or_si128(_mm_and_si128(_mm_srli_epi16(sum, 1), _mm_set1_epi8(0x7f)),
+			_mm_and_si128(_mm_slli_epi16(sum, 7), _mm_set1_epi8((char) 0x80)));
+		sum=_mm_add_epi8(sum, a[COLUMN[k]]);
+	}
+	_mm_storeu_si128((__m128i *) &cls->checksum[first], sum);
+}
+
+TARGET_AVX2 static void classifyAVX2(const union sDirEntry *de, u_int32_t first, struct sDirEntryClass *cls) {
+/*
+	classifies the 32 dir entries starting at first, like classifySSE2 but
+	with entries first to first+15 in the low and the others in the high lane
+*/
+	__m256i a[16], b[16];
+	__m256i sum, end, longName;
+	u_int32_t k, endBits, longBits;
+
+	for (k=0; k<16; k++) {
+		a[k]=_mm256_inserti128_si256(
+			_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) &de[first+k])),
+			_mm_loadu_si128((const __m128i *) &de[first+16+k]), 1);
+	}
+
+	for (k=0; k<8; k++) {
+		b[k]=_mm256_unpacklo_epi8(a[2*k], a[2*k+1]);
+		b[k+8]=_mm256_unpackhi_epi8(a[2*k], a[2*k+1]);
+	}
+	for (k=0; k<8; k++) {
+		a[k]=_mm256_unpacklo_epi16(b[2*k], b[2*k+1]);
+		a[k+8]=_mm256_unpackhi_epi16(b[2*k], b[2*k+1]);
+	}
+	for (k=0; k<8; k++) {
+		b[k]=_mm256_unpacklo_epi32(a[2*k], a[2*k+1]);
+		b[k+8]=_mm256_unpackhi_epi32(a[2*k], a[2*k+1]);
+	}
+	for (k=0; k<8; k++) {
+		a[k]=_mm256_unpacklo_epi64(b[2*k], b[2*k+1]);
+		a[k+8]=_mm256_unpackhi_epi64(b[2*k], b[2*k+1]);
+	}
+
+	end=_mm256_cmpeq_epi8(a[NAME0], _mm256_setzero_si256());
+	longName=_mm256_cmpeq_epi8(_mm256_and_si256(a[ATTR], _mm256_set1_epi8(ATTR_LONG_NAME_MASK)), _mm256_set1_epi8(ATTR_LONG_NAME));
+	endBits=(u_int32_t) _mm256_movemask_epi8(end);
+	longBits=(u_int32_t) _mm256_movemask_epi8(longName) & ~endBits;
+
+	cls->end|=(u_int64_t) endBits << first;
+	cls->longName|=(u_int64_t) longBits << first;
+	cls->shortName|=(u_int64_t) ~(endBits | longBits) << first;
+	cls->deleted|=(u_int64_t) (u_int32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(a[NAME0], _mm256_set1_epi8((char) DE_FREE))) << first;
+	cls->volumeLabel|=(u_int64_t) ((u_int32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+		_mm256_and_si256(a[ATTR], _mm256_set1_epi8(ATTR_VOLUME_ID)), _mm256_set1_epi8(ATTR_VOLUME_ID))) &
+		~(endBits | longBits)) << first;
+
+	sum=_mm256_setzero_si256();
+	for (k=0; k<11; k++) {
+		sum=_mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(sum, 1), _mm256_set1_epi8(0x7f)),
+			_mm256_and_si256(_mm256_slli_epi16(sum, 7), _mm256_set1_epi8((char) 0x80)));
+		sum=_mm256_add_epi8(sum, a[COLUMN[k]]);
+	}
+	_mm256_storeu_si256((__m256i *) &cls->checksum[first], sum);
+}
+#endif
+
+void classifyDirEntriesScalar(const union sDirEntry *de, u_int32_t n, struct sDirEntryClass *cls) {
+/*
+	classifies n dir entries one by one
+*/
+	assert(de != NULL);
+	assert(cls != NULL);
+	assert(n <= DIR_CLASS_BLOCK);
+
+	clearClass(cls);
+	classifyScalar(de, 0, n, cls);
+}
+
+#ifdef HAVE_X86_KERNELS
+TARGET_SSE2 void classifyDirEntriesSSE2(const union sDirEntry *de, u_int32_t n, struct sDirEntryClass *cls) {
+/*
+	classifies n dir entries, 16 at a time
+*/
+	assert(de != NULL);
+	assert(cls != NULL);
+	assert(n <= DIR_CLASS_BLOCK);
+
+	u_int32_t i;
+
+	clearClass(cls);
+	for (i=0; i + 16 <= n; i+=16) classifySSE2(de, i, cls);
+	classifyScalar(de, i, n, cls);
+}
+
+TARGET_AVX2 void classifyDirEntriesAVX2(const union sDirEntry *de, u_int32_t n, struct sDirEntryClass *cls) {
+/*
+	classifies n dir entries, 32 at a time
+*/
+	assert(de != NULL);
+	assert(cls != NULL);
+	assert(n <= DIR_CLASS_BLOCK);
+
+	u_int32_t i;
+
+	clearClass(cls);
+	for (i=0; i + 32 <= n; i+=32) classifyAVX2(de, i, cls);
+	for (; i + 16 <= n; i+=16) classifySSE2(de, i, cls);
+	classifyScalar(de, i, n, cls);
+}
+#endif
@@ -0,0 +1,59 @@
+/*
+	FATSort, utility for sorting FAT directory structures
+	Copyright (C) 2004 Boris Leidner <fatsort(at)formenos.de>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+	This file contains/describes functions for the classification of
+	directory entries in blocks.
+*/
+
+#ifndef __dirscan_h__
+#define __dirscan_h__
+
+#include <sys/types.h>
+#include "FAT_fs.h"
+#include "simd.h"
+
+// number of dir entries that are classified at once
+#define DIR_CLASS_BLOCK 64
+
+struct sDirEntryClass {
+/*
+	classification of a block of dir entries, bit i describes entry i
+*/
+	u_int64_t end;			// DIR_Name[0] is DE_FOLLOWING_FREE
+	u_int64_t deleted;		// DIR_Name[0] is DE_FREE
+	u_int64_t longName;		// long dir entry
+	u_int64_t shortName;		// short dir entry
+	u_int64_t volumeLabel;		// short dir entry with ATTR_VOLUME_ID
+	u_char checksum[DIR_CLASS_BLOCK];	// checksum of the short name of entry i
+};
+
+// classify up to DIR_CLASS_BLOCK dir entries and calculate their checksums,
+// bound to one of the variants below by initKernels
+extern void (*classifyDirEntries)(const union sDirEntry *de, u_int32_t n, struct sDirEntryClass *cls);
+
+// reference implementation
+void classifyDirEntriesScalar(const union sDirEntry *de, u_int32_t n, struct sDirEntryClass *cls);
+
+#ifdef HAVE_X86_KERNELS
+void classifyDirEntriesSSE2(const union sDirEntry *de, u_int32_t n, struct sDirEntryClass *cls);
+void classifyDirEntriesAVX2(const union sDirEntry *de, u_int32_t n, struct sDirEntryClass *cls);
+#endif
+
+#endif // __dirscan_h__
@@ -35,105 +35,52 @@
 #include "mallocv.h"
 #include "stringlist.h"
 #include "endianness.h"
+#include "rng.h"
 
-// random number
-u_int32_t irand( u_int32_t b, u_int32_t e)
-{
-    double r = e - b + 1;
-    return b + (u_int32_t)(r * rand()/(RAND_MAX+1.0));
-}
+// directories with at least this many files are sorted with radix sort
+#ifndef RADIX_SORT_THRESHOLD
+#define RADIX_SORT_THRESHOLD 1024
+#endif
 
-// List functions
+// buckets with less records are sorted with merge sort
+#define RADIX_MIN_BUCKET 32
 
-struct sDirEntryList * newDirEntryList(void) {
-/*
-	create new dir entry list
-*/
-	struct sDirEntryList *tmp;
+// end of key and 256 byte values
+#define RADIX_BUCKETS 257
 
-	if ((tmp=malloc(sizeof(struct sDirEntryList)))==NULL) {
-		stderror();
-		return NULL;
-	}
-	memset(tmp, 0, sizeof(struct sDirEntryList));
-	return tmp;
-}
+// compiled sort specification
+struct sSortSpec sortSpec;
+
+// Table functions
 
-struct sDirEntryList *
-	newDirEntry(char *sname, char *lname, struct sShortDirEntry *sde, struct sLongDirEntryList *ldel, u_int32_t entries) {
+struct sDirEntryTable *
+	newDirEntryTable(struct sArena *arena, union sDirEntry *entries, u_int32_t maxEntries) {
 /*
-	create a new directory entry holder
+	create new dir entry table
 */
-	assert(sname != NULL);
-	assert(lname != NULL);
-	assert(sde != NULL);
-	
-	struct sDirEntryList *tmp;
+	assert(arena != NULL);
+	assert(entries != NULL);
 
-	if ((tmp=malloc(sizeof(struct sDirEntryList)))==NULL) {
-		stderror();
-		return NULL;
-	}
-	if ((tmp->sname=malloc(strlen(sname)+1))==NULL) {
-		stderror();
-		free(tmp);
-		return NULL;
-	}
-	strcpy(tmp->sname, sname);
-	if ((tmp->lname=malloc(strlen(lname)+1))==NULL) {
-		stderror();
-		free(tmp->sname);
-		free(tmp);
-		return NULL;
-	}
-	strcpy(tmp->lname, lname);
+	struct sDirEntryTable *table;
 
-	if ((tmp->sde=malloc(sizeof(struct sShortDirEntry)))==NULL) {
-		stderror();
-		free(tmp->lname);
-		free(tmp->sname);
-		free(tmp);
+	if ((table=arenaAlloc(arena, sizeof(struct sDirEntryTable)))==NULL) {
 		return NULL;
 	}
-	memcpy(tmp->sde, sde, DIR_ENTRY_SIZE);
-	tmp->ldel=ldel;
-	tmp->entries=entries;
-	tmp->next = NULL;
-	return tmp;
-}
-
-struct sLongDirEntryList *
-	insertLongDirEntryList(struct sLongDirEntry *lde, struct sLongDirEntryList *list) {
-/*
-	insert a long directory entry to list
-*/
+	memset(table, 0, sizeof(struct sDirEntryTable));
 
-	assert(lde != NULL);
-
-	struct sLongDirEntryList *tmp, *new;
-
-	if ((new=malloc(sizeof(struct sLongDirEntryList)))==NULL) {
-		stderror();
+	// a directory can't hold more files than dir entries
+	if ((table->files=arenaAlloc(arena, (size_t) maxEntries * sizeof(struct sDirFile)))==NULL) {
 		return NULL;
 	}
-	if ((new->lde=malloc(sizeof(struct sLongDirEntry)))==NULL) {
-		stderror();
-		free(new);
+	if ((table->order=arenaAlloc(arena, (size_t) maxEntries * sizeof(struct sDirSortRecord)))==NULL) {
 		return NULL;
 	}
-	memcpy(new->lde, lde, DIR_ENTRY_SIZE);
-	new->next=NULL;
 
-	if (list != NULL) {
-		tmp=list;
-		while(tmp->next != NULL) {
-			tmp=tmp->next;
-		}
-		tmp->next=new;
-		return list;
-	} else {
-		return new;
-	}
+	table->entries=entries;
+	table->maxEntries=maxEntries;
+	table->arena=arena;
+
+	return table;
 }
 
 int32_t stripSpecialPrefixes(char *old, char *new) {
@@ -163,238 +110,519 @@ int32_t stripSpecialPrefixes(char *old, char *new) {
 	return 0;
 }
 
-int32_t cmpEntries(struct sDirEntryList *de1, struct sDirEntryList *de2) {
+char *stripStage(char *name, char *buf) {
 /*
-	compare two directory entries
+	name stage: strip special prefixes
 */
+	return stripSpecialPrefixes(name, buf) ? buf : name;
+}
 
-	assert(de1 != NULL);
-	assert(de2 != NULL);
-	
-	char s1[MAX_PATH_LEN+1];
-	char s2[MAX_PATH_LEN+1];
-	char s1_col[MAX_PATH_LEN*2+1];
-	char s2_col[MAX_PATH_LEN*2+1];
-	char scase1[MAX_PATH_LEN+1];
-	char scase2[MAX_PATH_LEN+1];
-
-	u_int16_t i;
+char *foldCaseStage(char *name, char *buf) {
+/*
+	name stage: ignore case
+*/
+	size_t i;
 
-	// the volume label must always remain at the beginning of the (root) directory
-	if ((de1->sde->DIR_Atrr & (ATTR_READ_ONLY | ATTR_HIDDEN | ATTR_SYSTEM | ATTR_VOLUME_ID | ATTR_DIRECTORY)) == ATTR_VOLUME_ID) {
-		return(-1);
-	} else if ((de2->sde->DIR_Atrr & (ATTR_READ_ONLY | ATTR_HIDDEN | ATTR_SYSTEM | ATTR_VOLUME_ID | ATTR_DIRECTORY)) == ATTR_VOLUME_ID) {
-		return(1);
-	// the special "." and ".." directories must always remain at the beginning of directories, in this order
-	} else if (strcmp(de1->sname, ".") == 0) {
-		return(-1);
-	} else if (strcmp(de2->sname, ".") == 0) {
-		return(1);
-	} else if (strcmp(de1->sname, "..") == 0) {
-		return(-1);
-	} else if (strcmp(de2->sname, "..") == 0) {
-		return(1);
-	// deleted entries should be moved to the end of the directory
-	} else if ((u_char) de1->sname[0] == DE_FREE) {
-		return(1);
-	} else if ((u_char) de2->sname[0] == DE_FREE) {
-		return(-1);
+	for (i=0; name[i] != '\0'; i++) {
+		buf[i] = tolower(name[i]);
 	}
+	buf[i]='\0';
+
+	return buf;
+}
 
-	char *ss1,*ss2;
+size_t encodeNatural(const char *name, char *key, size_t size) {
+/*
+	name encoder: natural order
+*/
+	// encode digit runs, so natural order is byte-wise order
+	if (strlen(name)*2+1 > size) return (size_t) -1;
+	return natstrkey(name, key);
+}
 
-	if ((de1->lname != NULL) && (de1->lname[0] != '\0')) {
-		ss1=de1->lname;
-	} else {
-		ss1=de1->sname;
+size_t encodeASCII(const char *name, char *key, size_t size) {
+/*
+	name encoder: ASCIIbetical order
+*/
+	size_t len=strlen(name);
+
+	if (len >= size) return (size_t) -1;
+	memcpy(key, name, len);
+
+	return len;
+}
+
+size_t encodeLocale(const char *name, char *key, size_t size) {
+/*
+	name encoder: collation order of the locale
+*/
+	size_t len=strxfrm(key, name, size);
+
+	if (len >= size) return (size_t) -1;
+
+	return len;
+}
+
+int32_t nameKeyStage(struct sDirFile *file, struct sShortDirEntry *sde, char *key, size_t *len) {
+/*
+	key stage: name of file, transformed by the compiled name stages
+*/
+	(void) sde;
+
+	char s[MAX_PATH_LEN+1];
+	char *ss;
+	size_t n;
+	u_int32_t i;
+
+	ss=(file->lname[0] != '\0') ? file->lname : file->sname;
+
+	for (i=0; i < sortSpec.nameStageCount; i++) {
+		ss=sortSpec.nameStages[i](ss, s);
 	}
-	if ((de2->lname != NULL) && (de2->lname[0] != '\0')) {
-		ss2=de2->lname;
-	} else {
-		ss2=de2->sname;
+
+	if ((n=sortSpec.encodeName(ss, key + *len, MAX_KEY_LEN - *len)) == (size_t) -1) {
+		myerror("String collation error!");
+		return -1;
 	}
-	
-	// it's not necessary to compare files for listing and randomization,
-	// each entry will be put to the end of the list
-	if (OPT_LIST || OPT_RANDOM) return 1;
+	*len+=n;
+
+	return 0;
+}
+
+int32_t timeKeyStage(struct sDirFile *file, struct sShortDirEntry *sde, char *key, size_t *len) {
+/*
+	key stage: last modification time, most significant byte first
+*/
+	(void) file;
+
+	u_int32_t md;
+
+	md = SwapInt16(sde->DIR_WrtDate)<<16 | SwapInt16(sde->DIR_WrtTime);
+	key[(*len)++]=(md >> 24) & 0xff;
+	key[(*len)++]=(md >> 16) & 0xff;
+	key[(*len)++]=(md >> 8) & 0xff;
+	key[(*len)++]=md & 0xff;
+
+	return 0;
+}
+
+int32_t compileSortSpec(void) {
+/*
+	build the sort specification from the options once,
+	so that keys are built and compared without testing options
+*/
+	const char *keys;
+
+	memset(&sortSpec, 0, sizeof(struct sSortSpec));
+
+	sortSpec.reverse=OPT_REVERSE;
+
+	// listing and random order don't sort by key
+	if (OPT_LIST || OPT_RANDOM) return 0;
+
+	sortSpec.sortByKey=1;
 
-	// directories will be put above normal files
+	// group of directories and files
 	if (OPT_ORDER == 0) {
-		if ((de1->sde->DIR_Atrr & ATTR_DIRECTORY) &&
-		   !(de2->sde->DIR_Atrr & ATTR_DIRECTORY)) {
-			return -1;
-		} else if (!(de1->sde->DIR_Atrr & ATTR_DIRECTORY) &&
-			    (de2->sde->DIR_Atrr & ATTR_DIRECTORY)) {
-			return 1;
-		}
+		sortSpec.fileGroup=1;
 	} else if (OPT_ORDER == 1) {
-		if ((de1->sde->DIR_Atrr & ATTR_DIRECTORY) &&
-		   !(de2->sde->DIR_Atrr & ATTR_DIRECTORY)) {
-			return 1;
-		} else if (!(de1->sde->DIR_Atrr & ATTR_DIRECTORY) &&
-			    (de2->sde->DIR_Atrr & ATTR_DIRECTORY)) {
-			return -1;
-		}
+		sortSpec.dirGroup=1;
 	}
 
-	// consider last modification time
-	if (OPT_MODIFICATION) {
-		u_int32_t md1, md2;
-		md1 = SwapInt16(de1->sde->DIR_WrtDate)<<16 | SwapInt16(de1->sde->DIR_WrtTime);
-		md2 = SwapInt16(de2->sde->DIR_WrtDate)<<16 | SwapInt16(de2->sde->DIR_WrtTime);
-		// printf("md1: %x, md2: %x\n", md1, md2);
-		if (md1 < md2)
-				return -OPT_REVERSE;
-		else if (md1 > md2)
-				return OPT_REVERSE;
-		else return 0;
+	if (OPT_SORT_KEYS != NULL) {
+		keys=OPT_SORT_KEYS;
+	} else if (OPT_MODIFICATION) {
+		keys="t";
+	} else {
+		keys="n";
 	}
 
-	// strip special prefixes
-	if (OPT_IGNORE_PREFIXES_LIST->next != NULL) {
-		if (stripSpecialPrefixes(ss1, s1)) {
-			ss1=s1;
-		}
-		if (stripSpecialPrefixes(ss2, s2)) {
-			ss2=s2;
+	sortSpec.fixedWidth=1;
+	for (; *keys != '\0'; keys++) {
+		assert(sortSpec.keyStageCount < MAX_SORT_KEYS);
+		switch(*keys) {
+		case SORT_KEY_TIME:
+			sortSpec.keyStages[sortSpec.keyStageCount++]=timeKeyStage;
+			sortSpec.keyWidth+=4;
+			break;
+		case SORT_KEY_NAME:
+			// name keys have variable length, so no other key may follow
+			assert(keys[1] == '\0');
+			sortSpec.keyStages[sortSpec.keyStageCount++]=nameKeyStage;
+			sortSpec.fixedWidth=0;
+			break;
+		default:
+			myerror("Unknown sort key '%c'!", *keys);
+			return -1;
 		}
 	}
 
-	//printf("Orig S1: %s, Orig S2: %s, Locale S1: %s, Locale S2: %s\n", ss1, ss2, s1_col, s2_col);
-
+	if (OPT_IGNORE_PREFIXES_LIST->next != NULL) {
+		sortSpec.nameStages[sortSpec.nameStageCount++]=stripStage;
+	}
 	if (OPT_IGNORE_CASE) {
-		i=0;
-		while(ss1[i]) {
-			scase1[i] = tolower(ss1[i]);
-			i++;
-		}
-		ss1=scase1;
-		i=0;
-		while(ss2[i]) {
-			scase2[i] = tolower(ss2[i]);
-			i++;
-		}
-		ss2=scase2;
+		sortSpec.nameStages[sortSpec.nameStageCount++]=foldCaseStage;
 	}
 
 	if (OPT_NATURAL_SORT) {
-		return natstrcmp(ss1, ss2) * OPT_REVERSE;
+		sortSpec.encodeName=encodeNatural;
 	} else if (OPT_ASCII) {
-		// use plain ASCII corder
-		return strcmp(ss1, ss2) * OPT_REVERSE;
- 	} else {
-
-		// consider locale for comparison
-		if ((strxfrm(s1_col, ss1, MAX_PATH_LEN*2) == MAX_PATH_LEN*2) ||
-		    (strxfrm(s2_col, ss2, MAX_PATH_LEN*2) == MAX_PATH_LEN*2)) {
-			myerror("String collation error!");
-			exit(1);
-		}
+		sortSpec.encodeName=encodeASCII;
+	} else {
+		sortSpec.encodeName=encodeLocale;
+	}
+
+	return 0;
+}
+
+int32_t setSortKey(struct sArena *arena, struct sDirSortRecord *rec, struct sDirFile *file, struct sShortDirEntry *sde) {
+/*
+	compute the sort key of a file once by running the compiled key stages
+*/
+	assert(arena != NULL);
+	assert(rec != NULL);
+	assert(file != NULL);
+	assert(sde != NULL);
+
+	char key[MAX_KEY_LEN+1];
+	size_t len=0, i;
+
+	rec->prefix=0;
+	rec->key=NULL;
+	rec->keylen=0;
+
+	// entries are not compared by key
+	if (!sortSpec.sortByKey || (DE_RANK(rec->class) != DE_RANK_FILE)) return 0;
 
-		return strcmp(s1_col, s2_col) * OPT_REVERSE;
-		
+	for (i=0; i < sortSpec.keyStageCount; i++) {
+		if (sortSpec.keyStages[i](file, sde, key, &len) == -1) return -1;
 	}
+
+	if ((rec->key=arenaAlloc(arena, len+1))==NULL) {
+		return -1;
+	}
+	memcpy(rec->key, key, len);
+	rec->key[len]='\0';
+	rec->keylen=len;
+
+	// most comparisons are decided by the prefix
+	for (i=0; i < 8; i++) {
+		rec->prefix = (rec->prefix << 8) | ((i < len) ? (u_char) key[i] : 0);
+	}
+
+	return 0;
 }
 
-void insertDirEntryList(struct sDirEntryList *new, struct sDirEntryList *list) {
+int32_t addDirFile(struct sDirEntryTable *table, char *sname, char *lname, u_int32_t first, u_int32_t entries) {
 /*
-	insert a directory entry into list
+	add a file to table, its dir entries stay in the table
 */
+	assert(table != NULL);
+	assert(sname != NULL);
+	assert(lname != NULL);
+	assert(entries > 0);
+	assert(first + entries <= table->maxEntries);
+	assert(table->fileCount < table->maxEntries);
 
-	assert(new != NULL);
-	assert(list != NULL);
+	struct sDirFile *file=&table->files[table->fileCount];
+	struct sDirSortRecord *rec=&table->order[table->fileCount];
+	struct sShortDirEntry *sde;
+	u_int32_t rank, group=0;
 
-	struct sDirEntryList *tmp, *dummy;
+	if ((file->sname=arenaStrdup(table->arena, sname))==NULL) {
+		return -1;
+	}
+	if ((file->lname=arenaStrdup(table->arena, lname))==NULL) {
+		return -1;
+	}
+	file->first=first;
+	file->entries=entries;
 
-	tmp=list;
+	sde=FILE_SDE(table, file);
 
-	while ((tmp->next != NULL) &&
-		(cmpEntries(new, tmp->next) >= 0)) {
-		tmp=tmp->next;
+	// the volume label must always remain at the beginning of the (root) directory
+	// the special "." and ".." directories must always remain at the beginning of directories, in this order
+	// deleted entries should be moved to the end of the directory
+	if ((sde->DIR_Atrr & (ATTR_READ_ONLY | ATTR_HIDDEN | ATTR_SYSTEM | ATTR_VOLUME_ID | ATTR_DIRECTORY)) == ATTR_VOLUME_ID) {
+		rank=DE_RANK_LABEL;
+	} else if (strcmp(sname, ".") == 0) {
+		rank=DE_RANK_DOT;
+	} else if (strcmp(sname, "..") == 0) {
+		rank=DE_RANK_DOTDOT;
+	} else if ((u_char) sname[0] == DE_FREE) {
+		rank=DE_RANK_DELETED;
+	} else {
+		rank=DE_RANK_FILE;
+		group=(sde->DIR_Atrr & ATTR_DIRECTORY) ? sortSpec.dirGroup : sortSpec.fileGroup;
 	}
+
+	rec->index=table->fileCount;
+	rec->class=DE_CLASS(rank, group);
+
+	if (setSortKey(table->arena, rec, file, sde) == -1) {
+		myerror("Failed to compute sort key!");
+		return -1;
+	}
+
+	table->fileCount++;
+	table->entryCount+=entries;
+
+	return 0;
+}
+
+int32_t cmpEntries(const struct sDirSortRecord *r1, const struct sDirSortRecord *r2) {
+/*
+	compare two sort records
+*/
+
+	assert(r1 != NULL);
+	assert(r2 != NULL);
 	
-	dummy=tmp->next;
-	tmp->next=new;
-	new->next=dummy;
+	int32_t r;
+
+	// pinned entries, deleted entries and the groups of files and directories
+	if (r1->class != r2->class) {
+		return (r1->class < r2->class) ? -1 : 1;
+	}
+
+	// entries without key keep their order, e.g. for listing and randomization
+	if (r1->key == NULL) return 0;
+
+	// compare precomputed sort keys (name or last modification time)
+	if (r1->prefix != r2->prefix) {
+		return ((r1->prefix < r2->prefix) ? -1 : 1) * sortSpec.reverse;
+	}
+	r=memcmp(r1->key, r2->key, r1->keylen < r2->keylen ? r1->keylen : r2->keylen);
+	if (r == 0) {
+		if (r1->keylen < r2->keylen) r=-1;
+		else if (r1->keylen > r2->keylen) r=1;
+	}
+	return (r < 0 ? -1 : (r > 0 ? 1 : 0)) * sortSpec.reverse;
+}
+
+void mergeSortRecords(struct sDirSortRecord *recs, struct sDirSortRecord *tmp, u_int32_t n) {
+/*
+	stable merge sort of sort records, tmp must hold n/2 records.
+	Like insertion into a sorted list, a record is only moved before an earlier
+	record if it compares less than that record.
+*/
+
+	assert(recs != NULL);
+	assert(tmp != NULL);
+
+	u_int32_t m, i, j, k;
+
+	if (n < 2) return;
+
+	m = n / 2;
+	mergeSortRecords(recs, tmp, m);
+	mergeSortRecords(recs + m, tmp, n - m);
+
+	// both halves are already in order
+	if (cmpEntries(&recs[m], &recs[m-1]) >= 0) return;
+
+	memcpy(tmp, recs, m * sizeof(struct sDirSortRecord));
+
+	i=0; j=m; k=0;
+	while ((i < m) && (j < n)) {
+		if (cmpEntries(&recs[j], &tmp[i]) < 0) {
+			recs[k++]=recs[j++];
+		} else {
+			recs[k++]=tmp[i++];
+		}
+	}
+	while (i < m) {
+		recs[k++]=tmp[i++];
+	}
 }
 
-void freeDirEntryList(struct sDirEntryList *list) {
+static inline u_int32_t keyByte(const struct sDirSortRecord *rec, u_int32_t depth) {
 /*
-	free dir entry list
+	byte of key at depth, 0 if the key ends before depth
 */
+	return (depth < rec->keylen) ? (u_char) rec->key[depth] + 1 : 0;
+}
 
-/*	char *sname, *lname;		// short and long name strings
-	struct sShortDirEntry *sde;	// short dir entry
-	struct sLongDirEntryList *ldel;	// long name entries in a list
-	int32_t entries;		// number of entries
-	struct sDirEntryList *next;	// next dir entry
+void msdRadixSortRecords(struct sDirSortRecord *recs, struct sDirSortRecord *tmp, u_int32_t n, u_int32_t depth) {
+/*
+	stable MSD radix sort of records of the same class by their key bytes from
+	depth on, tmp must hold n records. Gives the same order as cmpEntries().
 */
-	assert(list != NULL);
 
-	struct sDirEntryList *tmp;
-	struct sLongDirEntryList *ldelist, *tmp2;
-	
-	while(list != NULL) {
-		if (list->sname) free(list->sname);
-		if (list->lname) free(list->lname);
-		if (list->sde) free(list->sde);
-		
-		ldelist=list->ldel;
-		while(ldelist != NULL) {
-			free(ldelist->lde);
-			tmp2=ldelist;
-			ldelist = ldelist->next;
-			free(tmp2);
+	assert(recs != NULL);
+	assert(tmp != NULL);
+
+	u_int32_t count[RADIX_BUCKETS], offset[RADIX_BUCKETS];
+	u_int32_t i, b, pos;
+
+	while (1) {
+		// small buckets are sorted faster by comparison
+		if (n < RADIX_MIN_BUCKET) {
+			mergeSortRecords(recs, tmp, n);
+			return;
+		}
+
+		memset(count, 0, sizeof(count));
+		for (i=0; i < n; i++) {
+			count[keyByte(&recs[i], depth)]++;
+		}
+
+		// skip common prefixes without moving records
+		b=keyByte(&recs[0], depth);
+		if (count[b] != n) break;
+		if (b == 0) return;	// all keys are equal
+		depth++;
+	}
+
+	// bucket offsets, shorter keys first, in reverse order last
+	pos=0;
+	for (i=0; i < RADIX_BUCKETS; i++) {
+		b=(sortSpec.reverse == 1) ? i : RADIX_BUCKETS - 1 - i;
+		offset[b]=pos;
+		pos+=count[b];
+	}
+
+	for (i=0; i < n; i++) {
+		tmp[offset[keyByte(&recs[i], depth)]++]=recs[i];
+	}
+	memcpy(recs, tmp, n * sizeof(struct sDirSortRecord));
+
+	// sort buckets by the next byte, equal keys are done
+	for (b=1; b < RADIX_BUCKETS; b++) {
+		if (count[b] > 1) {
+			msdRadixSortRecords(recs + offset[b] - count[b], tmp, count[b], depth + 1);
 		}
-		
-		tmp=list;
-		list=list->next;
-		free(tmp);
 	}
 }
 
-void randomizeDirEntryList(struct sDirEntryList *list, u_int32_t entries) {
+void lsdRadixSortRecords(struct sDirSortRecord *recs, struct sDirSortRecord *tmp, u_int32_t n) {
 /*
-	randomize entry list
+	stable LSD radix sort of records of the same class by their 4 byte
+	modification time keys, tmp must hold n records
 */
-	assert(list != NULL);
 
-	struct sDirEntryList *randlist, *tmp, *dummy1, *dummy2;
-	u_int32_t i, j, pos;
+	assert(recs != NULL);
+	assert(tmp != NULL);
+
+	struct sDirSortRecord *src=recs, *dst=tmp, *swap;
+	u_int32_t count[256], offset[256];
+	u_int32_t i, b, pos, shift;
+
+	for (shift=0; shift < 32; shift+=8) {
+		memset(count, 0, sizeof(count));
+		for (i=0; i < n; i++) {
+			count[(src[i].prefix >> (32 + shift)) & 0xff]++;
+		}
+
+		// nothing to do if all records have the same digit
+		if (count[(src[0].prefix >> (32 + shift)) & 0xff] == n) continue;
+
+		pos=0;
+		for (i=0; i < 256; i++) {
+			b=(sortSpec.reverse == 1) ? i : 255 - i;
+			offset[b]=pos;
+			pos+=count[b];
+		}
+
+		for (i=0; i < n; i++) {
+			dst[offset[(src[i].prefix >> (32 + shift)) & 0xff]++]=src[i];
+		}
+
+		swap=src; src=dst; dst=swap;
+	}
+
+	if (src != recs) {
+		memcpy(recs, src, n * sizeof(struct sDirSortRecord));
+	}
+}
+
+void radixSortRecords(struct sDirSortRecord *recs, struct sDirSortRecord *tmp, u_int32_t n) {
+/*
+	stable radix sort of sort records, tmp must hold n records.
+	Records are distributed by class first, then the files are sorted by key.
+*/
+
+	assert(recs != NULL);
+	assert(tmp != NULL);
+
+	u_int32_t count[DE_CLASSES]={0}, offset[DE_CLASSES];
+	u_int32_t i, c, pos=0;
+
+	for (i=0; i < n; i++) {
+		count[recs[i].class]++;
+	}
+	for (c=0; c < DE_CLASSES; c++) {
+		offset[c]=pos;
+		pos+=count[c];
+	}
+	for (i=0; i < n; i++) {
+		tmp[offset[recs[i].class]++]=recs[i];
+	}
+	memcpy(recs, tmp, n * sizeof(struct sDirSortRecord));
+
+	for (c=0; c < DE_CLASSES; c++) {
+		if ((DE_RANK(c) != DE_RANK_FILE) || (count[c] < 2)) continue;
+		if (sortSpec.fixedWidth && (sortSpec.keyWidth == 4)) {
+			lsdRadixSortRecords(recs + offset[c] - count[c], tmp, count[c]);
+		} else {
+			msdRadixSortRecords(recs + offset[c] - count[c], tmp, count[c], 0);
+		}
+	}
+}
+
+int32_t sortDirEntryTable(struct sDirEntryTable *table) {
+/*
+	sort files of table, large directories are sorted with radix sort
+*/
+
+	assert(table != NULL);
+
+	struct sDirSortRecord *tmp;
+
+	if (table->fileCount < 2) return 0;
+
+	if ((tmp=malloc(table->fileCount * sizeof(struct sDirSortRecord)))==NULL) {
+		stderror();
+		return -1;
+	}
+
+	if ((table->fileCount >= RADIX_SORT_THRESHOLD) && sortSpec.sortByKey) {
+		radixSortRecords(table->order, tmp, table->fileCount);
+	} else {
+		mergeSortRecords(table->order, tmp, table->fileCount);
+	}
+
+	free(tmp);
+
+	return 0;
+}
+
+void randomizeDirEntryTable(struct sDirEntryTable *table) {
+/*
+	randomize order of files with a Fisher-Yates shuffle
+*/
+	assert(table != NULL);
+
+	struct sDirSortRecord tmp, *recs;
+	u_int32_t i, j, n;
 	u_int32_t skip=0;
-	
-	randlist=list;
-	
+
 	// the volume label must always remain at the beginning of the (root) directory
 	// the special "." and ".." directories must always remain at the beginning of directories, so skip them
-	while (randlist->next &&
-		(((randlist->next->sde->DIR_Atrr &
-		(ATTR_READ_ONLY | ATTR_HIDDEN | ATTR_SYSTEM | ATTR_VOLUME_ID | ATTR_DIRECTORY)) == ATTR_VOLUME_ID) ||
-		(strcmp(randlist->next->sname, ".") == 0) ||
-		(strcmp(randlist->next->sname, "..") == 0))) {
-
-		DEBUGMSG("skipping randomization for %s", randlist->next->sname)
-		randlist=randlist->next;
+	while ((skip < table->fileCount) &&
+		(DE_RANK(table->order[skip].class) < DE_RANK_FILE)) {
+
+		DEBUGMSG("skipping randomization for %s", table->files[table->order[skip].index].sname)
 		skip++;
 	}
-	
-	for (i=skip; i < entries; i++) {
-		pos=irand(0, entries - 1 - i);
-		
-		tmp=randlist;
-		// after the loop tmp->next is the selected item
-		for (j=0; j<pos; j++) {
-			tmp=tmp->next;
-		}
-		
-		// put selected entry to top of list
-		dummy1=tmp->next;
-		tmp->next=dummy1->next;
-
-		dummy2=randlist->next;
-		randlist->next=dummy1;
-		dummy1->next=dummy2;
-		
-		randlist=randlist->next;
+
+	recs=table->order + skip;
+	n=table->fileCount - skip;
+
+	for (i=n; i > 1; i--) {
+		j=randomBelow(i);
+		tmp=recs[i-1];
+		recs[i-1]=recs[j];
+		recs[j]=tmp;
 	}
 }
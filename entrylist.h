@@ -19,7 +19,7 @@
 
 /*
 	This file contains/describes some ADOs which are used to
-	represent the structures of FAT directory entries and entry lists.
+	represent the structures of FAT directory entries and entry tables.
 */
 
 #ifndef __entrylist_h__
@@ -27,50 +27,102 @@
 
 #include <sys/types.h>
 #include "FAT_fs.h"
+#include "arena.h"
+#include "options.h"
 
-struct sLongDirEntryList {
+// ranks of directory entries, entries are sorted by rank first
+#define DE_RANK_LABEL		0	// volume label
+#define DE_RANK_DOT		1	// "." directory
+#define DE_RANK_DOTDOT		2	// ".." directory
+#define DE_RANK_FILE		3	// file or directory, sorted by key
+#define DE_RANK_DELETED		4	// deleted entry
+
+// sort class of a record: rank and group of files and directories (OPT_ORDER)
+#define DE_CLASS(rank, group)	(((rank) << 1) | (group))
+#define DE_RANK(class)		((class) >> 1)
+#define DE_CLASSES		DE_CLASS(DE_RANK_DELETED + 1, 0)
+
+// maximum length of a sort key
+#define MAX_KEY_LEN (MAX_PATH_LEN*2 + 4*MAX_SORT_KEYS + 1)
+
+struct sDirFile;
+
+struct sSortSpec {
 /*
-	list structures for directory entries
-	list structure for a long name entry
+	sort specification that is compiled once from the options
 */
-	struct sLongDirEntry *lde;
-	struct sLongDirEntryList *next;
+	int32_t reverse;		// 1 for normal, -1 for reverse order
+	u_int32_t sortByKey;		// 0 for listing and random order
+	u_int32_t dirGroup, fileGroup;	// groups of directories and files
+	u_int32_t fixedWidth;		// all keys have keyWidth bytes
+	u_int32_t keyWidth;		// width of fixed width keys
+	// key stages, each one appends its key to key
+	int32_t (*keyStages[MAX_SORT_KEYS])(struct sDirFile *file, struct sShortDirEntry *sde, char *key, size_t *len);
+	u_int32_t keyStageCount;
+	// name stages, each one transforms a name, possibly into buf
+	char *(*nameStages[2])(char *name, char *buf);
+	u_int32_t nameStageCount;
+	// encodes a name as byte-wise comparable key, returns (size_t) -1 if key doesn't fit into size bytes
+	size_t (*encodeName)(const char *name, char *key, size_t size);
 };
 
-struct sDirEntryList {
+extern struct sSortSpec sortSpec;
+
+struct sDirFile {
 /*
-	list structure for every file with short
-	name entries and long name entries
+	file in a directory table with short and long name strings
+	and the span of its long and short dir entries in the table
 */
 	char *sname, *lname;		// short and long name strings
-	struct sShortDirEntry *sde;	// short dir entry
-	struct sLongDirEntryList *ldel;	// long name entries in a list
-	u_int32_t entries;		// number of entries
-	struct sDirEntryList *next;	// next dir entry
+	u_int32_t first;		// index of first dir entry of file
+	u_int32_t entries;		// number of dir entries, short dir entry is last
+};
+
+struct sDirSortRecord {
+/*
+	compact record of a file that is used for sorting
+*/
+	u_int64_t prefix;		// first 8 bytes of key, most significant first
+	char *key;			// precomputed sort key, NULL if not sorted by key
+	u_int32_t keylen;		// length of sort key
+	u_int32_t class;		// sort class, see DE_CLASS
+	u_int32_t index;		// index of file in files
+};
+
+struct sDirEntryTable {
+/*
+	table of a directory: the raw dir entries as they were read, the files in
+	the order of the directory and the sort records in sorted order
+*/
+	union sDirEntry *entries;	// raw dir entries (directory buffer)
+	u_int32_t maxEntries;		// number of raw dir entries
+	struct sDirFile *files;		// files in order of directory
+	struct sDirSortRecord *order;	// sort records in sorted order
+	u_int32_t fileCount;		// number of files
+	u_int32_t entryCount;		// number of dir entries of all files
+	struct sArena *arena;		// arena for names, keys and arrays
 };
 
-// create new dir entry list
-struct sDirEntryList *
-	newDirEntryList(void);
+// short dir entry of file f in table t
+#define FILE_SDE(t, f) (&(t)->entries[(f)->first + (f)->entries - 1].ShortDirEntry)
 
-// randomize entry list
-void randomizeDirEntryList(struct sDirEntryList *list, u_int32_t entries);
+// create new dir entry table for maxEntries raw dir entries, allocated from arena
+struct sDirEntryTable *
+	newDirEntryTable(struct sArena *arena, union sDirEntry *entries, u_int32_t maxEntries);
 
-// create a new directory entry holder
-struct sDirEntryList *
-	newDirEntry(char *sname, char *lname, struct sShortDirEntry *sde, struct sLongDirEntryList *ldel, u_int32_t entries);
+// compile sort specification from options
+int32_t compileSortSpec(void);
 
-// insert a long directory entry to list
-struct sLongDirEntryList *
-	insertLongDirEntryList(struct sLongDirEntry *lde, struct sLongDirEntryList *list);
+// add a file with entries dir entries starting at index first to table
+int32_t addDirFile(struct sDirEntryTable *table, char *sname, char *lname, u_int32_t first, u_int32_t entries);
 
-// compare two directory entries
-int32_t cmpEntries(struct sDirEntryList *de1, struct sDirEntryList *de2);
+// randomize order of files
+void randomizeDirEntryTable(struct sDirEntryTable *table);
 
-// insert a directory entry into list
-void insertDirEntryList(struct sDirEntryList *new, struct sDirEntryList *list);
+// compare two sort records
+int32_t cmpEntries(const struct sDirSortRecord *r1, const struct sDirSortRecord *r2);
 
-// free dir entry list
-void freeDirEntryList(struct sDirEntryList *list);
+// sort files of table with a stable O(n log n) sort
+int32_t sortDirEntryTable(struct sDirEntryTable *table);
 
 #endif // __entrylist_h__
@@ -0,0 +1,197 @@
+/*
+	FATSort, utility for sorting FAT directory structures
+	Copyright (C) 2004 Boris Leidner <fatsort(at)formenos.de>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+	This file contains/describes the analysis of the cluster graph of a FAT.
+	Every used cluster points to its successor, so the FAT is a graph in
+	which chains are paths that end with an end of chain mark.
+*/
+
+#include "fatgraph.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include "errors.h"
+#include "mallocv.h"
+
+// initial size of the path stack
+#define INITIAL_PATH_SIZE 1024
+
+#define ON_PATH(b, c) ((b)[(c) / 8] & (1 << ((c) % 8)))
+
+static int32_t isChainEnd(struct sFileSystem *fs, u_int32_t data) {
+/*
+	checks whether data ends a chain like in getClusterChain
+*/
+	return isEOC(fs, data) || ((fs->FATType == FATTYPE_FAT32) && (data == 0x0ff8fff8));
+}
+
+struct sFATGraph *newFATGraph(struct sFileSystem *fs) {
+/*
+	analyzes the cluster graph of the in-memory FAT. Each cluster is walked
+	only until a cluster with known chain length is reached, then the
+	lengths are assigned backwards along the walked path. So every FAT entry
+	is followed once. Clusters on the path are marked in the cluster bitmap
+	of fs, reaching a marked cluster means a loop.
+*/
+	assert(fs != NULL);
+	assert(fs->FAT != NULL);
+	assert(fs->clusterBitmap != NULL);
+
+	struct sFATGraph *graph;
+	u_int32_t *path, *tmp;
+	u_int32_t pathSize=INITIAL_PATH_SIZE, top;
+	u_int32_t s, c, next, length, badValue;
+	u_int32_t *FAT=fs->FAT;
+	u_int8_t *onPath=fs->clusterBitmap;
+
+	if ((graph=malloc(sizeof(struct sFATGraph))) == NULL) {
+		stderror();
+		return NULL;
+	}
+	memset(graph, 0, sizeof(struct sFATGraph));
+	graph->entries=(u_int32_t) fs->clusters+2;
+
+	if ((graph->length=calloc(graph->entries, sizeof(u_int32_t))) == NULL) {
+		stderror();
+		free(graph);
+		return NULL;
+	}
+	if ((graph->inDegree=calloc(graph->entries, sizeof(u_int8_t))) == NULL) {
+		stderror();
+		free(graph->length);
+		free(graph);
+		return NULL;
+	}
+	if ((path=malloc(pathSize * sizeof(u_int32_t))) == NULL) {
+		stderror();
+		freeFATGraph(graph);
+		return NULL;
+	}
+
+	if (fs->FATType == FATTYPE_FAT32) {
+		badValue=0x0FFFFFF7;
+	} else if (fs->FATType == FATTYPE_FAT16) {
+		badValue=0x0000FFF7;
+	} else {
+		badValue=0x00000FF7;
+	}
+
+	for (s=0; s<graph->entries; s++) {
+		if (FAT[s] == 0) continue;
+
+		// count predecessors, the reserved clusters 0 and 1 are not part of chains
+		next=FAT[s];
+		if ((s >= 2) && (next >= 2) && (next < graph->entries) && !isChainEnd(fs, next)) {
+			if (graph->inDegree[next] < 255) graph->inDegree[next]++;
+		}
+		if (next == badValue) {
+			graph->badClusters++;
+		} else if (isChainEnd(fs, next)) {
+			graph->EOCClusters++;
+		}
+
+		if (graph->length[s] != 0) continue;
+
+		// walk the chain until its end or a cluster with known length
+		top=0;
+		c=s;
+		while (1) {
+			if (graph->length[c] != 0) {
+				length=graph->length[c];
+				break;
+			}
+			if (ON_PATH(onPath, c)) {
+				graph->loops++;
+				length=FAT_CHAIN_BROKEN;
+				break;
+			}
+			if (top == pathSize) {
+				if ((tmp=realloc(path, pathSize * 2 * sizeof(u_int32_t))) == NULL) {
+					stderror();
+					while (top > 0) {
+						top--;
+						onPath[path[top] / 8] &= ~(1 << (path[top] % 8));
+					}
+					free(path);
+					freeFATGraph(graph);
+					return NULL;
+				}
+				path=tmp;
+				pathSize*=2;
+			}
+			path[top++]=c;
+			onPath[c / 8] |= (1 << (c % 8));
+
+			next=FAT[c];
+			if (isChainEnd(fs, next)) {
+				length=0;
+				break;
+			}
+			if ((next >= graph->entries) || (FAT[next] == 0)) {
+				length=FAT_CHAIN_BROKEN;
+				break;
+			}
+			c=next;
+		}
+
+		// assign the lengths backwards and release the path
+		while (top > 0) {
+			c=path[--top];
+			onPath[c / 8] &= ~(1 << (c % 8));
+			if ((length == FAT_CHAIN_BROKEN) || (length >= fs->maxClusterChainLength)) {
+				length=FAT_CHAIN_BROKEN;
+			} else {
+				length++;
+			}
+			graph->length[c]=length;
+		}
+	}
+
+	free(path);
+
+	// summary
+	for (c=2; c<graph->entries; c++) {
+		if (FAT[c] == 0) continue;
+		if (graph->inDegree[c] > 1) graph->crossLinked++;
+		if ((graph->length[c] == FAT_CHAIN_BROKEN) && (FAT[c] != badValue)) graph->brokenClusters++;
+		if ((graph->inDegree[c] == 0) && (FAT[c] != badValue)) {
+			graph->chains++;
+			if ((graph->length[c] != FAT_CHAIN_BROKEN) && (graph->length[c] > graph->longestChain)) {
+				graph->longestChain=graph->length[c];
+				graph->longestChainHead=c;
+			}
+		}
+	}
+
+	return graph;
+}
+
+void freeFATGraph(struct sFATGraph *graph) {
+/*
+	free cluster graph
+*/
+	assert(graph != NULL);
+
+	free(graph->length);
+	free(graph->inDegree);
+	free(graph);
+}
@@ -0,0 +1,59 @@
+/*
+	FATSort, utility for sorting FAT directory structures
+	Copyright (C) 2004 Boris Leidner <fatsort(at)formenos.de>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+	This file contains/describes the analysis of the cluster graph of a FAT.
+	Every used cluster points to its successor, so the FAT is a graph in
+	which chains are paths that end with an end of chain mark.
+*/
+
+#ifndef __fatgraph_h__
+#define __fatgraph_h__
+
+#include <sys/types.h>
+#include "FAT_fs.h"
+
+// chain length of clusters whose chain is broken: loops, missing or free successors,
+// bad clusters and chains that are too long
+#define FAT_CHAIN_BROKEN 0xFFFFFFFF
+
+struct sFATGraph {
+/*
+	cluster graph of a FAT, the arrays have one element per FAT entry
+*/
+	u_int32_t entries;		// number of FAT entries
+	u_int32_t *length;		// remaining chain length of every cluster, 0 for free clusters
+	u_int8_t *inDegree;		// number of clusters pointing to a cluster (saturates at 255)
+	u_int32_t chains;		// number of chain heads (used clusters without predecessor)
+	u_int32_t longestChain;		// length of the longest intact chain
+	u_int32_t longestChainHead;	// first cluster of that chain
+	u_int32_t crossLinked;		// clusters with more than one predecessor
+	u_int32_t loops;		// number of loops
+	u_int32_t brokenClusters;	// used clusters with a broken chain, apart from bad clusters
+	u_int32_t EOCClusters;		// clusters marked as end of chain
+	u_int32_t badClusters;		// clusters marked as bad
+};
+
+// analyze the cluster graph of the in-memory FAT of fs in one pass
+struct sFATGraph *newFATGraph(struct sFileSystem *fs);
+
+// free cluster graph
+void freeFATGraph(struct sFATGraph *graph);
+
+#endif // __fatgraph_h__
@@ -0,0 +1,469 @@
+/*
+	FATSort, utility for sorting FAT directory structures
+	Copyright (C) 2004 Boris Leidner <fatsort(at)formenos.de>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+	This file contains/describes kernels for decoding and scanning FATs.
+*/
+
+#include "fatscan.h"
+
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+#ifdef HAVE_X86_KERNELS
+#include <immintrin.h>
+#endif
+#include "endianness.h"
+#include "mallocv.h"
+
+// FATs are scanned by one thread per FAT_STATS_THREAD_ENTRIES entries
+#ifndef FAT_STATS_THREAD_ENTRIES
+#define FAT_STATS_THREAD_ENTRIES (4*1024*1024)
+#endif
+#define MAX_FAT_STATS_THREADS 16
+
+void (*decodeFAT12Entries)(const u_char *src, u_int32_t *dst, u_int32_t n) = decodeFAT12EntriesScalar;
+void (*decodeFAT16Entries)(const u_char *src, u_int32_t *dst, u_int32_t n) = decodeFAT16EntriesScalar;
+void (*decodeFAT32Entries)(const u_char *src, u_int32_t *dst, u_int32_t n) = decodeFAT32EntriesScalar;
+void (*maskFATEntries)(const u_int32_t *FAT, u_int32_t n, u_int32_t badValue, u_int64_t *freeMask, u_int64_t *badMask) = maskFATEntriesScalar;
+
+void decodeFAT12EntriesScalar(const u_char *src, u_int32_t *dst, u_int32_t n) {
+/*
+	decodes n FAT12 entries, two entries from three bytes at a time
+*/
+	assert((src != NULL) || (n == 0));
+	assert((dst != NULL) || (n == 0));
+
+	u_int32_t i;
+	const u_char *b;
+
+	for (i=0; i + 2 <= n; i+=2) {
+		b=src + i + i/2;
+		dst[i]=b[0] | ((b[1] & 0x0f) << 8);	// cluster number is even
+		dst[i+1]=(b[1] >> 4) | (b[2] << 4);	// cluster number is odd
+	}
+	if (i < n) {
+		b=src + i + i/2;
+		dst[i]=b[0] | ((b[1] & 0x0f) << 8);
+	}
+}
+
+void decodeFAT16EntriesScalar(const u_char *src, u_int32_t *dst, u_int32_t n) {
+/*
+	decodes n FAT16 entries one by one
+*/
+	assert((src != NULL) || (n == 0));
+	assert((dst != NULL) || (n == 0));
+
+	u_int32_t i;
+	u_int16_t value;
+
+	for (i=0; i<n; i++) {
+		memcpy(&value, src + 2*i, 2);
+		dst[i]=SwapInt16(value);
+	}
+}
+
+void decodeFAT32EntriesScalar(const u_char *src, u_int32_t *dst, u_int32_t n) {
+/*
+	decodes n FAT32 entries one by one
+*/
+	assert((src != NULL) || (n == 0));
+	assert((dst != NULL) || (n == 0));
+
+	u_int32_t i;
+	u_int32_t value;
+
+	for (i=0; i<n; i++) {
+		memcpy(&value, src + 4*i, 4);
+		dst[i]=SwapInt32(value) & 0x0fffffff;
+	}
+}
+
+void maskFATEntriesScalar(const u_int32_t *FAT, u_int32_t n, u_int32_t badValue, u_int64_t *freeMask, u_int64_t *badMask) {
+/*
+	marks free and bad entries one by one
+*/
+	assert(FAT != NULL);
+	assert(n <= 64);
+	assert(freeMask != NULL);
+	assert(badMask != NULL);
+
+	u_int32_t i;
+
+	*freeMask=0;
+	*badMask=0;
+	for (i=0; i<n; i++) {
+		if (FAT[i] == 0) *freeMask|=(u_int64_t) 1 << i;
+		if (FAT[i] == badValue) *badMask|=(u_int64_t) 1 << i;
+	}
+}
+
+#ifdef HAVE_X86_KERNELS
+// the vectorized variants assume a little endian host, which x86 is
+
+TARGET_SSE2 void decodeFAT16EntriesSSE2(const u_char *src, u_int32_t *dst, u_int32_t n) {
+/*
+	decodes n FAT16 entries, 8 at a time
+*/
+	assert((src != NULL) || (n == 0));
+	assert((dst != NULL) || (n == 0));
+
+	u_int32_t i;
+	__m128i v;
+
+	for (i=0; i + 8 <= n; i+=8) {
+		v=_mm_loadu_si128((const __m128i *) (src + 2*i));
+		_mm_storeu_si128((__m128i *) (dst + i), _mm_unpacklo_epi16(v, _mm_setzero_si128()));
+		_mm_storeu_si128((__m128i *) (dst + i + 4), _mm_unpackhi_epi16(v, _mm_setzero_si128()));
+	}
+	decodeFAT16EntriesScalar(src + 2*i, dst + i, n - i);
+}
+
+TARGET_SSE2 void decodeFAT32EntriesSSE2(const u_char *src, u_int32_t *dst, u_int32_t n) {
+/*
+	decodes n FAT32 entries, 4 at a time
+*/
+	assert((src != NULL) || (n == 0));
+	assert((dst != NULL) || (n == 0));
+
+	u_int32_t i;
+	__m128i mask=_mm_set1_epi32(0x0fffffff);
+
+	for (i=0; i + 4 <= n; i+=4) {
+		_mm_storeu_si128((__m128i *) (dst + i),
+			_mm_and_si128(_mm_loadu_si128((const __m128i *) (src + 4*i)), mask));
+	}
+	decodeFAT32EntriesScalar(src + 4*i, dst + i, n - i);
+}
+
+TARGET_SSE2 void maskFATEntriesSSE2(const u_int32_t *FAT, u_int32_t n, u_int32_t badValue, u_int64_t *freeMask, u_int64_t *badMask) {
+/*
+	marks free and bad entries, 4 at a time
+*/
+	assert(FAT != NULL);
+	assert(n <= 64);
+	assert(freeMask != NULL);
+	assert(badMask != NULL);
+
+	u_int32_t i;
+	u_int64_t restFree, restBad;
+	__m128i v, badVector=_mm_set1_epi32((int) badValue);
+
+	*freeMask=0;
+	*badMask=0;
+	for (i=0; i + 4 <= n; i+=4) {
+		v=_mm_loadu_si128((const __m128i *) (FAT + i));
+		*freeMask|=(u_int64_t) _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v, _mm_setzero_si128()))) << i;
+		*badMask|=(u_int64_t) _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v, badVector))) << i;
+	}
+
+	// the rest, a full block leaves none and must not shift by 64
+	if (i < n) {
+		maskFATEntriesScalar(FAT + i, n - i, badValue, &restFree, &restBad);
+		*freeMask|=restFree << i;
+		*badMask|=restBad << i;
+	}
+}
+
+TARGET_SSSE3 void decodeFAT12EntriesSSSE3(const u_char *src, u_int32_t *dst, u_int32_t n) {
+/*
+	decodes n FAT12 entries, 8 entries from 12 bytes at a time. The bytes of
+	each entry are shuffled into a 16 bit lane, then even entries are masked
+	and odd entries shifted.
+*/
+	assert((src != NULL) || (n == 0));
+	assert((dst != NULL) || (n == 0));
+
+	u_int32_t i;
+	__m128i v;
+	const __m128i shuffle=_mm_setr_epi8(0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11);
+	const __m128i even=_mm_setr_epi16(0x0fff, 0, 0x0fff, 0, 0x0fff, 0, 0x0fff, 0);
+
+	// the 16 byte loads must not read beyond the bytes of the n entries
+	for (i=0; i*3/2 + 16 <= (n*3 + 1)/2; i+=8) {
+		v=_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (src + i*3/2)), shuffle);
+		v=_mm_or_si128(_mm_and_si128(v, even), _mm_andnot_si128(even, _mm_srli_epi16(v, 4)));
+		_mm_storeu_si128((__m128i *) (dst + i), _mm_unpacklo_epi16(v, _mm_setzero_si128()));
+		_mm_storeu_si128((__m128i *) (dst + i + 4), _mm_unpackhi_epi16(v, _mm_setzero_si128()));
+	}
+	decodeFAT12EntriesScalar(src + i*3/2, dst + i, n - i);
+}
+
+TARGET_AVX2 void decodeFAT12EntriesAVX2(const u_char *src, u_int32_t *dst, u_int32_t n) {
+/*
+	decodes n FAT12 entries, 16 entries from 24 bytes at a time,
+	like decodeFAT12EntriesSSSE3 with 12 bytes in each lane
+*/
+	assert((src != NULL) || (n == 0));
+	assert((dst != NULL) || (n == 0));
+
+	u_int32_t i;
+	__m256i v;
+	const __m256i shuffle=_mm256_setr_epi8(0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11,
+		0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11);
+	const __m256i even=_mm256_setr_epi16(0x0fff, 0, 0x0fff, 0, 0x0fff, 0, 0x0fff, 0,
+		0x0fff, 0, 0x0fff, 0, 0x0fff, 0, 0x0fff, 0);
+
+	for (i=0; i*3/2 + 28 <= (n*3 + 1)/2; i+=16) {
+		v=_mm256_inserti128_si256(
+			_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) (src + i*3/2))),
+			_mm_loadu_si128((const __m128i *) (src + i*3/2 + 12)), 1);
+		v=_mm256_shuffle_epi8(v, shuffle);
+		v=_mm256_or_si256(_mm256_and_si256(v, even), _mm256_andnot_si256(even, _mm256_srli_epi16(v, 4)));
+		_mm256_storeu_si256((__m256i *) (dst + i), _mm256_cvtepu16_epi32(_mm256_castsi256_si128(v)));
+		_mm256_storeu_si256((__m256i *) (dst + i + 8), _mm256_cvtepu16_epi32(_mm256_extracti128_si256(v, 1)));
+	}
+	decodeFAT12EntriesSSSE3(src + i*3/2, dst + i, n - i);
+}
+
+TARGET_AVX2 void decodeFAT16EntriesAVX2(const u_char *src, u_int32_t *dst, u_int32_t n) {
+/*
+	decodes n FAT16 entries, 16 at a time
+*/
+	assert((src != NULL) || (n == 0));
+	assert((dst != NULL) || (n == 0));
+
+	u_int32_t i;
+
+	for (i=0; i + 16 <= n; i+=16) {
+		_mm256_storeu_si256((__m256i *) (dst + i),
+			_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) (src + 2*i))));
+		_mm256_storeu_si256((__m256i *) (dst + i + 8),
+			_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) (src + 2*i + 16))));
+	}
+	decodeFAT16EntriesSSE2(src + 2*i, dst + i, n - i);
+}
+
+TARGET_AVX2 void decodeFAT32EntriesAVX2(const u_char *src, u_int32_t *dst, u_int32_t n) {
+/*
+	decodes n FAT32 entries, 8 at a time
+*/
+	assert((src != NULL) || (n == 0));
+	assert((dst != NULL) || (n == 0));
+
+	u_int32_t i;
+	__m256i mask=_mm256_set1_epi32(0x0fffffff);
+
+	for (i=0; i + 8 <= n; i+=8) {
+		_mm256_storeu_si256((__m256i *) (dst + i),
+			_mm256_and_si256(_mm256_loadu_si256((const __m256i *) (src + 4*i)), mask));
+	}
+	decodeFAT32EntriesSSE2(src + 4*i, dst + i, n - i);
+}
+
+TARGET_AVX2 void maskFATEntriesAVX2(const u_int32_t *FAT, u_int32_t n, u_int32_t badValue, u_int64_t *freeMask, u_int64_t *badMask) {
+/*
+	marks free and bad entries, 8 at a time
+*/
+	assert(FAT != NULL);
+	assert(n <= 64);
+	assert(freeMask != NULL);
+	assert(badMask != NULL);
+
+	u_int32_t i;
+	u_int64_t restFree, restBad;
+	__m256i v, badVector=_mm256_set1_epi32((int) badValue);
+
+	*freeMask=0;
+	*badMask=0;
+	for (i=0; i + 8 <= n; i+=8) {
+		v=_mm256_loadu_si256((const __m256i *) (FAT + i));
+		*freeMask|=(u_int64_t) _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v, _mm256_setzero_si256()))) << i;
+		*badMask|=(u_int64_t) _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v, badVector))) << i;
+	}
+
+	// the rest, a full block leaves none and must not shift by 64
+	if (i < n) {
+		maskFATEntriesSSE2(FAT + i, n - i, badValue, &restFree, &restBad);
+		*freeMask|=restFree << i;
+		*badMask|=restBad << i;
+	}
+}
+#endif
+
+static void addFreeRun(struct sFATStats *stats, u_int32_t start, u_int32_t length) {
+/*
+	accounts a run of free entries, the first of equally large runs is kept
+*/
+	stats->freeRuns++;
+	if (length > stats->largestFree) {
+		stats->largestFree=length;
+		stats->largestFreeStart=start;
+	}
+}
+
+static void scanFATEntries(const u_int32_t *FAT, u_int32_t first, u_int32_t n, u_int32_t badValue, struct sFATStats *stats) {
+/*
+	gathers the statistics of n decoded FAT entries in one pass. The entries
+	are turned into free and bad masks of 64 entries, used and bad clusters
+	are counted with popcount and free runs are followed bit run by bit run.
+*/
+	u_int32_t i, m, pos, len, run=0, runStart=0;
+	u_int64_t freeMask, badMask, rest, valid;
+
+	memset(stats, 0, sizeof(struct sFATStats));
+	stats->entries=n;
+
+	for (i=0; i<n; i+=64) {
+		m=(n - i < 64) ? n - i : 64;
+		maskFATEntries(FAT + i, m, badValue, &freeMask, &badMask);
+		valid=(m == 64) ? ~(u_int64_t) 0 : ((u_int64_t) 1 << m) - 1;
+
+		stats->used+=m - __builtin_popcountll(freeMask);
+		stats->bad+=__builtin_popcountll(badMask);
+
+		// fast paths for completely used and completely free blocks
+		if ((freeMask == 0) && (run == 0)) continue;
+		if (freeMask == valid) {
+			if (run == 0) runStart=first + i;
+			run+=m;
+			continue;
+		}
+
+		for (pos=0; pos<m; pos+=len) {
+			rest=freeMask >> pos;
+			if (rest & 1) {
+				len=(~rest == 0) ? 64 - pos : (u_int32_t) __builtin_ctzll(~rest);
+				if (len > m - pos) len=m - pos;
+				if (run == 0) runStart=first + i + pos;
+				run+=len;
+			} else {
+				if (run > 0) {
+					if (runStart == first) stats->leadingFree=run;
+					addFreeRun(stats, runStart, run);
+					run=0;
+				}
+				len=(rest == 0) ? 64 - pos : (u_int32_t) __builtin_ctzll(rest);
+			}
+		}
+	}
+
+	// the run at the end of the range
+	if (run > 0) {
+		if (runStart == first) stats->leadingFree=run;
+		stats->trailingFree=run;
+		addFreeRun(stats, runStart, run);
+	}
+}
+
+static void mergeFATStats(struct sFATStats *stats, const struct sFATStats *next, u_int32_t nextFirst) {
+/*
+	merges the statistics of the range that directly follows into stats,
+	nextFirst is the cluster of the first entry of that range
+*/
+	u_int32_t joined=0;
+
+	stats->used+=next->used;
+	stats->bad+=next->bad;
+	stats->freeRuns+=next->freeRuns;
+
+	// free runs that touch at the border are one run
+	if ((stats->trailingFree > 0) && (next->leadingFree > 0)) {
+		joined=stats->trailingFree + next->leadingFree;
+		stats->freeRuns--;
+		if (joined > stats->largestFree) {
+			stats->largestFree=joined;
+			stats->largestFreeStart=nextFirst - stats->trailingFree;
+		}
+	}
+	if (next->largestFree > stats->largestFree) {
+		stats->largestFree=next->largestFree;
+		stats->largestFreeStart=next->largestFreeStart;
+	}
+
+	if (stats->leadingFree == stats->entries) stats->leadingFree+=next->leadingFree;
+	if (next->trailingFree == next->entries) {
+		stats->trailingFree+=next->entries;
+	} else {
+		stats->trailingFree=next->trailingFree;
+	}
+	stats->entries+=next->entries;
+}
+
+struct sFATStatsJob {
+/*
+	range of the FAT that is scanned by one thread
+*/
+	const u_int32_t *FAT;
+	u_int32_t first;
+	u_int32_t n;
+	u_int32_t badValue;
+	struct sFATStats stats;
+};
+
+static void *FATStatsThread(void *arg) {
+/*
+	scans the range of a job
+*/
+	struct sFATStatsJob *job=(struct sFATStatsJob *) arg;
+
+	scanFATEntries(job->FAT, job->first, job->n, job->badValue, &job->stats);
+
+	return NULL;
+}
+
+void getFATStats(const u_int32_t *FAT, u_int32_t first, u_int32_t n, u_int32_t badValue, struct sFATStats *stats) {
+/*
+	gathers the statistics of n decoded FAT entries. FATs with more than
+	FAT_STATS_THREAD_ENTRIES entries are split into ranges that are scanned
+	in parallel and merged afterwards.
+*/
+	assert(FAT != NULL);
+	assert(stats != NULL);
+
+	struct sFATStatsJob jobs[MAX_FAT_STATS_THREADS];
+	pthread_t threads[MAX_FAT_STATS_THREADS];
+	u_int32_t started[MAX_FAT_STATS_THREADS];
+	u_int32_t count, size, i;
+	long cpus;
+
+	count=n / FAT_STATS_THREAD_ENTRIES;
+	cpus=sysconf(_SC_NPROCESSORS_ONLN);
+	if ((cpus > 0) && (count > (u_int32_t) cpus)) count=(u_int32_t) cpus;
+	if (count > MAX_FAT_STATS_THREADS) count=MAX_FAT_STATS_THREADS;
+
+	if (count <= 1) {
+		scanFATEntries(FAT, first, n, badValue, stats);
+		return;
+	}
+
+	// ranges are multiples of the 64 entries of a mask
+	size=((n + count - 1) / count + 63) & ~(u_int32_t) 63;
+	count=(n + size - 1) / size;
+	for (i=0; i<count; i++) {
+		jobs[i].FAT=FAT + i*size;
+		jobs[i].first=first + i*size;
+		jobs[i].n=(i == count - 1) ? n - i*size : size;
+		jobs[i].badValue=badValue;
+		// scan the range here if no thread can be started
+		started[i]=(pthread_create(&threads[i], NULL, FATStatsThread, &jobs[i]) == 0);
+		if (!started[i]) FATStatsThread(&jobs[i]);
+	}
+
+	for (i=0; i<count; i++) {
+		if (started[i]) pthread_join(threads[i], NULL);
+	}
+
+	*stats=jobs[0].stats;
+	for (i=1; i<count; i++) {
+		mergeFATStats(stats, &jobs[i].stats, jobs[i].first);
+	}
+}
@@ -0,0 +1,82 @@
+/*
+	FATSort, utility for sorting FAT directory structures
+	Copyright (C) 2004 Boris Leidner <fatsort(at)formenos.de>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+	This file contains/describes kernels for decoding and scanning FATs.
+*/
+
+#ifndef __fatscan_h__
+#define __fatscan_h__
+
+#include <sys/types.h>
+#include "simd.h"
+
+// the following function pointers are bound to one of the variants below by initKernels
+
+// decode n raw FAT12 entries, two entries are packed into three bytes
+extern void (*decodeFAT12Entries)(const u_char *src, u_int32_t *dst, u_int32_t n);
+
+// decode n raw FAT16 entries
+extern void (*decodeFAT16Entries)(const u_char *src, u_int32_t *dst, u_int32_t n);
+
+// decode n raw FAT32 entries, the upper four bits are reserved
+extern void (*decodeFAT32Entries)(const u_char *src, u_int32_t *dst, u_int32_t n);
+
+// mark free entries and entries equal to badValue in up to 64 decoded FAT entries,
+// bit i describes entry i
+extern void (*maskFATEntries)(const u_int32_t *FAT, u_int32_t n, u_int32_t badValue, u_int64_t *freeMask, u_int64_t *badMask);
+
+// reference implementations
+void decodeFAT12EntriesScalar(const u_char *src, u_int32_t *dst, u_int32_t n);
+void decodeFAT16EntriesScalar(const u_char *src, u_int32_t *dst, u_int32_t n);
+void decodeFAT32EntriesScalar(const u_char *src, u_int32_t *dst, u_int32_t n);
+void maskFATEntriesScalar(const u_int32_t *FAT, u_int32_t n, u_int32_t badValue, u_int64_t *freeMask, u_int64_t *badMask);
+
+#ifdef HAVE_X86_KERNELS
+void decodeFAT16EntriesSSE2(const u_char *src, u_int32_t *dst, u_int32_t n);
+void decodeFAT32EntriesSSE2(const u_char *src, u_int32_t *dst, u_int32_t n);
+void maskFATEntriesSSE2(const u_int32_t *FAT, u_int32_t n, u_int32_t badValue, u_int64_t *freeMask, u_int64_t *badMask);
+
+void decodeFAT12EntriesSSSE3(const u_char *src, u_int32_t *dst, u_int32_t n);
+
+void decodeFAT12EntriesAVX2(const u_char *src, u_int32_t *dst, u_int32_t n);
+void decodeFAT16EntriesAVX2(const u_char *src, u_int32_t *dst, u_int32_t n);
+void decodeFAT32EntriesAVX2(const u_char *src, u_int32_t *dst, u_int32_t n);
+void maskFATEntriesAVX2(const u_int32_t *FAT, u_int32_t n, u_int32_t badValue, u_int64_t *freeMask, u_int64_t *badMask);
+#endif
+
+struct sFATStats {
+/*
+	statistics of a range of decoded FAT entries
+*/
+	u_int32_t entries;		// number of entries
+	u_int32_t used;			// non-zero entries
+	u_int32_t bad;			// entries equal to the bad cluster mark
+	u_int32_t freeRuns;		// number of runs of free entries
+	u_int32_t largestFree;		// length of the largest run of free entries
+	u_int32_t largestFreeStart;	// cluster of the first entry of that run
+	u_int32_t leadingFree;		// free entries at the start of the range
+	u_int32_t trailingFree;		// free entries at the end of the range
+};
+
+// gather statistics of n decoded FAT entries starting with cluster first,
+// large FATs are split across threads
+void getFATStats(const u_int32_t *FAT, u_int32_t first, u_int32_t n, u_int32_t badValue, struct sFATStats *stats);
+
+#endif // __fatscan_h__
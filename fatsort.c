@@ -41,6 +41,11 @@
 #include "sort.h"
 #include "clusterchain.h"
 #include "misc.h"
+#include "rng.h"
+#include "entrylist.h"
+#include "simd.h"
+#include "fatscan.h"
+#include "fatgraph.h"
 #include "platform.h"
 #include "mallocv.h"
 
@@ -67,6 +72,18 @@
 				"\t\tPrint some help\n\n" \
 				"\t-i\tPrint file system information only\n\n" \
 				"\t-I PFX\tIgnore file name PFX\n\n" \
+				"\t--io=BACKEND\n\n" \
+				"\t\tAccess the device with I/O BACKEND, one of\n\n" \
+				"\t\t\tpread : positional reads and writes (default)\n\n" \
+				"\t\t\tstdio : buffered streams\n\n" \
+				"\t\t\tmemory : read the whole device into memory and write back changed ranges\n\n" \
+				"\t\t\tmmap : map the image file into memory (image files only)\n\n" \
+				"\t\t\turing : batch directory reads and writes with io_uring (Linux only)\n\n" \
+				"\t--io-depth=N\n\n" \
+				"\t\tKeep up to N transfers in flight with io_uring (default 32)\n\n" \
+				"\t-k KEYS\tSort by KEYS, a sequence of the following keys where n must be last\n\n" \
+				"\t\t\tt : last modification date and time\n\n" \
+				"\t\t\tn : file name (default)\n\n" \
 				"\t-l\tPrint current order of files only\n\n" \
 				"\t-o FLAG\tSort order of files where FLAG is one of\n\n" \
 				"\t\t\td : directories first (default)\n\n" \
@@ -76,6 +93,13 @@
 				"\t-q\tBe quiet\n\n" \
 				"\t-r\tSort in reverse order\n\n" \
 				"\t-R\tSort in random order\n\n" \
+				"\t--seed=N\n\n" \
+				"\t\tSeed for random order, the same seed gives the same order\n\n" \
+				"\t-s POLICY\tSync policy for written directories where POLICY is one of\n\n" \
+				"\t\t\td[N] : sync after every N directories (default, N=1)\n\n" \
+				"\t\t\tb[N] : sync after N written bytes (default N=16777216)\n\n" \
+				"\t\t\te : sync once at the end\n\n" \
+				"\t\t\tr : start writeback after every directory and sync at the end (Linux only)\n\n" \
 				"\t-t\tSort by last modification date and time\n\n" \
 				"\t-v, --version\n\n" \
 				"\t\tPrint version information\n\n" \
@@ -123,33 +147,29 @@ int32_t printFSInfo(char *filename) {
 
 	assert(filename != NULL);
 
-	u_int32_t value, clen;
-	int32_t usedClusters, badClusters;
+	u_int32_t value, badValue;
+	struct sFATStats stats;
+	struct sFATGraph *graph;
 	int32_t i;
-	struct sClusterChain *chain;
 
 	struct sFileSystem fs;
 
 	printf("\t- File system information -\n");
 
-	if (openFileSystem(filename, FS_MODE_RO, &fs)) {
+	if (openFileSystem(filename, FS_MODE_RO, OPT_IO_BACKEND, &fs)) {
 		myerror("Failed to open file system!");
 		return -1;
 	}
 
-	usedClusters=0;
-	badClusters=0;
-	for (i=2; i<fs.clusters+2; i++) {
-		getFATEntry(&fs, i, &value);
-		if ((value & 0x0FFFFFFF) != 0) usedClusters++;
-		if (fs.FATType == FATTYPE_FAT32) {
-			if ((value & 0x0FFFFFFF) == 0x0FFFFFF7) badClusters++;
-		} else if (fs.FATType == FATTYPE_FAT16) {
-			if (value == 0x0000FFF7) badClusters++;
-		} else if (fs.FATType == FATTYPE_FAT12) {
-			if (value == 0x00000FF7) badClusters++;
-		}
+	// count used, bad and free clusters in the decoded FAT
+	if (fs.FATType == FATTYPE_FAT32) {
+		badValue=0x0FFFFFF7;
+	} else if (fs.FATType == FATTYPE_FAT16) {
+		badValue=0x0000FFF7;
+	} else {
+		badValue=0x00000FF7;
 	}
+	getFATStats(fs.FAT + 2, 2, fs.clusters, badValue, &stats);
 
 	printf("Device:\t\t\t\t\t%s\n", fs.path);
 	printf("Type:\t\t\t\t\tFAT%d\n", (int) fs.FATType);
@@ -158,7 +178,12 @@ int32_t printFSInfo(char *filename) {
 	printf("Number of FATs:\t\t\t\t%d %s\n", fs.bs.BS_NumFATs, (checkFATs(&fs) ? "- WARNING: FATs are different!" : ""));
 	printf("Cluster size:\t\t\t\t%d bytes\n", (int) fs.clusterSize);
 	printf("Max. cluster chain length:\t\t%d clusters\n", (int) fs.maxClusterChainLength);
-	printf("Data clusters (total / used / bad):\t%d / %d / %d\n", (int) fs.clusters, (int) usedClusters, (int) badClusters);
+	printf("Data clusters (total / used / bad):\t%d / %d / %d\n", (int) fs.clusters, (int) stats.used, (int) stats.bad);
+	printf("Free extents (count / largest):\t\t%u / %u clusters\n", stats.freeRuns, stats.largestFree);
+	if (stats.largestFree > 0) {
+		printf("Largest free extent:\t\t\tclusters 0x%x - 0x%x\n",
+			stats.largestFreeStart, stats.largestFreeStart + stats.largestFree - 1);
+	}
 	printf("FS size:\t\t\t\t%.2f MiBytes\n", (float) fs.FSSize / (1024.0*1024));
 	if (fs.FATType == FATTYPE_FAT32) {
 		if (getFATEntry(&fs, SwapInt32(fs.bs.FATxx.FAT32.BS_RootClus), &value) == -1) {
@@ -176,25 +201,27 @@ int32_t printFSInfo(char *filename) {
 	}
 
 	if (OPT_MORE_INFO) {
+		// chain lengths of all clusters from one analysis of the FAT
+		if ((graph=newFATGraph(&fs)) == NULL) {
+			myerror("Failed to analyze FAT!");
+			closeFileSystem(&fs);
+			return -1;
+		}
+
 		printf("\n\t- FAT -\n");
+		printf("Chains (count / longest):\t\t%u / %u clusters\n", graph->chains, graph->longestChain);
+		printf("Cross-linked clusters:\t\t\t%u\n", graph->crossLinked);
+		printf("Clusters in broken chains:\t\t%u (%u loops)\n", graph->brokenClusters, graph->loops);
 		printf("Cluster \tFAT entry\tChain length\n");
 		for (i=0; i<fs.clusters+2; i++) {
 			getFATEntry(&fs, i, &value);
 
-			clen=0;
-			if ((value & 0x0FFFFFFF ) != 0) {
-				if ((chain=newClusterChain()) == NULL) {
-					myerror("Failed to generate new ClusterChain!");
-					return -1;
-				}
-				clen=getClusterChain(&fs, i, chain);
-				freeClusterChain(chain);
-			}
-
-			printf("%08x\t%08x\t%u\n", i, value, clen);
+			// broken chains are printed as 4294967295
+			printf("%08x\t%08x\t%u\n", i, value, graph->length[i]);
 
 		}
 
+		freeFATGraph(graph);
 	}
 
 	closeFileSystem(&fs);
@@ -210,9 +237,6 @@ int main(int argc, char *argv[]) {
 
 	char *locale;
 
-	// initialize rng
-	srand(time(0));
-
 	// initialize blocked signals
 	init_signal_handling();
 	char *filename;
@@ -222,6 +246,12 @@ int main(int argc, char *argv[]) {
 		return -1;
 	}
 
+	// initialize rng
+	seedRandom(OPT_SEED);
+
+	// select vectorized kernels for this cpu
+	initKernels(detectCPUFeatures());
+
 	// use locale from environment or option
 	locale=setlocale(LC_ALL, OPT_LOCALE);
 	if (locale == NULL) {
@@ -231,6 +261,12 @@ int main(int argc, char *argv[]) {
 		myerror("WARNING: The C locale does not support all multibyte characters!");
 	}
 
+	// build the sort specification once
+	if (compileSortSpec() == -1) {
+		myerror("Failed to compile sort specification!");
+		return -1;
+	}
+
 	if (OPT_HELP) {
 		printf(INFO_OPTION_HELP);
 		return 0;
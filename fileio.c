@@ -21,23 +21,806 @@
 	This file contains file io functions for UNIX/Linux
 */
 
+#if defined(__linux__)
+#define _GNU_SOURCE	// sync_file_range
+#endif
+
 #include "fileio.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <sys/types.h>
+#include <sys/param.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <limits.h>
+#include "errors.h"
+#include "uring.h"
+#include "mallocv.h"
+
+// count of separately tracked dirty ranges of the memory and mmap backends
+#define DIRTY_RANGES 32
+
+// written ranges that have not been written back yet, sorted and disjoint
+struct sDirtyRanges {
+	u_int32_t count;
+	struct {
+		off_t start, end;
+	} range[DIRTY_RANGES+1];	// one spare range for merging
+};
+
+// state of the memory backend
+struct sMemoryIO {
+	u_char *data;		// copy of the whole device
+	struct sDirtyRanges dirty;
+};
+
+// queue depth for file systems opened from now on
+static u_int32_t IOQueueDepth = DEFAULT_IO_QUEUE_DEPTH;
+
+// state of the mmap backend
+struct sMmapIO {
+	u_char *data;		// shared mapping of the whole image file
+	struct sDirtyRanges dirty;	// page aligned
+};
+
+static ssize_t preadFull(int32_t fd, void *buf, size_t size, off_t offset) {
+/*
+	reads size bytes at offset, retries interrupted and partial reads
+*/
+	size_t done=0;
+	ssize_t n;
+
+	while (done < size) {
+		n=pread(fd, (u_char *) buf + done, size - done, offset + done);
+		if (n == -1) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		if (n == 0) break;	// end of file
+		done+=n;
+	}
+
+	return done;
+}
+
+static ssize_t pwriteFull(int32_t fd, const void *buf, size_t size, off_t offset) {
+/*
+	writes size bytes at offset, retries interrupted and partial writes
+*/
+	size_t done=0;
+	ssize_t n;
+
+	while (done < size) {
+		n=pwrite(fd, (const u_char *) buf + done, size - done, offset + done);
+		if (n == -1) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		if (n == 0) break;
+		done+=n;
+	}
+
+	return done;
+}
+
+static ssize_t preadvFull(int32_t fd, const struct iovec *iov, int32_t count, off_t offset) {
+/*
+	reads count buffers from consecutive bytes at offset,
+	partial reads are completed buffer by buffer
+*/
+	int32_t i;
+	ssize_t n, m, done=0;
+
+	do {
+		n=preadv(fd, iov, MIN(count, IOV_MAX), offset);
+	} while ((n == -1) && (errno == EINTR));
+	if (n == -1) return -1;
+
+	for (i=0; i < count; i++) {
+		if ((size_t) n >= iov[i].iov_len) {
+			n-=iov[i].iov_len;
+			done+=iov[i].iov_len;
+			continue;
+		}
+		m=preadFull(fd, (u_char *) iov[i].iov_base + n, iov[i].iov_len - n, offset + done + n);
+		if (m == -1) return -1;
+		done+=n+m;
+		if ((size_t) (n+m) < iov[i].iov_len) break;	// end of file
+		n=0;
+	}
+
+	return done;
+}
+
+static ssize_t pwritevFull(int32_t fd, const struct iovec *iov, int32_t count, off_t offset) {
+/*
+	writes count buffers to consecutive bytes at offset,
+	partial writes are completed buffer by buffer
+*/
+	int32_t i;
+	ssize_t n, m, done=0;
+
+	do {
+		n=pwritev(fd, iov, MIN(count, IOV_MAX), offset);
+	} while ((n == -1) && (errno == EINTR));
+	if (n == -1) return -1;
+
+	for (i=0; i < count; i++) {
+		if ((size_t) n >= iov[i].iov_len) {
+			n-=iov[i].iov_len;
+			done+=iov[i].iov_len;
+			continue;
+		}
+		m=pwriteFull(fd, (const u_char *) iov[i].iov_base + n, iov[i].iov_len - n, offset + done + n);
+		if (m == -1) return -1;
+		done+=n+m;
+		if ((size_t) (n+m) < iov[i].iov_len) break;
+		n=0;
+	}
+
+	return done;
+}
+
+static void addDirtyRange(struct sDirtyRanges *dirty, off_t start, off_t end) {
+/*
+	adds a written range, ranges that touch are merged. If there are too many ranges,
+	the two neighbours with the smallest gap are merged, so that little clean data
+	is written back with them
+*/
+	u_int32_t i, j, best;
+
+	for (i=0; (i < dirty->count) && (dirty->range[i].end < start); i++);
+
+	if ((i < dirty->count) && (dirty->range[i].start <= end)) {
+		dirty->range[i].start=MIN(dirty->range[i].start, start);
+		dirty->range[i].end=MAX(dirty->range[i].end, end);
+		for (j=i+1; (j < dirty->count) && (dirty->range[j].start <= dirty->range[i].end); j++) {
+			dirty->range[i].end=MAX(dirty->range[i].end, dirty->range[j].end);
+		}
+		memmove(&dirty->range[i+1], &dirty->range[j], (dirty->count - j) * sizeof(dirty->range[0]));
+		dirty->count-=j-i-1;
+		return;
+	}
+
+	memmove(&dirty->range[i+1], &dirty->range[i], (dirty->count - i) * sizeof(dirty->range[0]));
+	dirty->range[i].start=start;
+	dirty->range[i].end=end;
+	dirty->count++;
+
+	if (dirty->count > DIRTY_RANGES) {
+		best=0;
+		for (i=1; i+1 < dirty->count; i++) {
+			if (dirty->range[i+1].start - dirty->range[i].end <
+			    dirty->range[best+1].start - dirty->range[best].end) {
+				best=i;
+			}
+		}
+		dirty->range[best].end=dirty->range[best+1].end;
+		memmove(&dirty->range[best+1], &dirty->range[best+2],
+			(dirty->count - best - 2) * sizeof(dirty->range[0]));
+		dirty->count--;
+	}
+}
+
+static int32_t syncFD(int32_t fd, u_int32_t wait) {
+/*
+	syncs fd to the device, only starts writeback if wait is zero
+*/
+
+	if (!wait) {
+#if defined(__LINUX__)
+		if (sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WRITE) != 0) {
+			myerror("Could not start writeback!");
+			return -1;
+		}
+#endif
+		return 0;
+	}
+
+	if (fsync(fd) != 0) {
+		myerror("Could not sync file descriptor!");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int32_t stdioOpen(struct sFileIO *io) {
+/*
+	connects the file descriptor to a stream
+*/
+	FILE *stream;
+
+	if ((stream=fdopen(io->fd, io->writable ? "r+b" : "rb")) == NULL) {
+		stderror();
+		return -1;
+	}
+	io->state=stream;
+
+	return 0;
+}
+
+static ssize_t stdioReadAt(struct sFileIO *io, void *buf, size_t size, off_t offset) {
+	FILE *stream=io->state;
+	size_t n;
+
+	if (fseeko(stream, offset, SEEK_SET) != 0) return -1;
+
+	n=fread(buf, 1, size, stream);
+	if ((n < size) && ferror(stream)) {
+		clearerr(stream);
+		return -1;
+	}
+
+	return n;
+}
+
+static ssize_t stdioWriteAt(struct sFileIO *io, const void *buf, size_t size, off_t offset) {
+	FILE *stream=io->state;
+	size_t n;
+
+	if (fseeko(stream, offset, SEEK_SET) != 0) return -1;
+
+	n=fwrite(buf, 1, size, stream);
+	if (n < size) {
+		clearerr(stream);
+		return -1;
+	}
+
+	return n;
+}
+
+static int32_t stdioFlush(struct sFileIO *io) {
+	if (fflush((FILE *) io->state) != 0) {
+		myerror("Could not flush stream!");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int32_t stdioSync(struct sFileIO *io, u_int32_t wait) {
+	if (stdioFlush(io)) return -1;
+
+	return syncFD(io->fd, wait);
+}
+
+static int32_t stdioClose(struct sFileIO *io) {
+/*
+	closes the stream and with it the file descriptor
+*/
+	if (fclose((FILE *) io->state) != 0) {
+		stderror();
+		return -1;
+	}
+
+	return 0;
+}
+
+static int32_t preadOpen(struct sFileIO *io) {
+/*
+	positional I/O needs no state, the file offset is never used
+*/
+	(void) io;
+
+	return 0;
+}
+
+static ssize_t preadReadAt(struct sFileIO *io, void *buf, size_t size, off_t offset) {
+	return preadFull(io->fd, buf, size, offset);
+}
+
+static ssize_t preadWriteAt(struct sFileIO *io, const void *buf, size_t size, off_t offset) {
+	return pwriteFull(io->fd, buf, size, offset);
+}
+
+static ssize_t preadReadvAt(struct sFileIO *io, const struct iovec *iov, int32_t count, off_t offset) {
+	return preadvFull(io->fd, iov, count, offset);
+}
+
+static ssize_t preadWritevAt(struct sFileIO *io, const struct iovec *iov, int32_t count, off_t offset) {
+	return pwritevFull(io->fd, iov, count, offset);
+}
+
+static void preadAdvise(struct sFileIO *io, off_t offset, size_t size, u_int32_t pattern) {
+#if defined(POSIX_FADV_SEQUENTIAL)
+	if (pattern == IO_ACCESS_SEQUENTIAL) {
+		posix_fadvise(io->fd, offset, size, POSIX_FADV_SEQUENTIAL);
+		posix_fadvise(io->fd, offset, size, POSIX_FADV_WILLNEED);
+	} else {
+		posix_fadvise(io->fd, offset, size, POSIX_FADV_RANDOM);
+	}
+#else
+	(void) io; (void) offset; (void) size; (void) pattern;
+#endif
+}
+
+static int32_t preadFlush(struct sFileIO *io) {
+/*
+	nothing is buffered
+*/
+	(void) io;
+
+	return 0;
+}
+
+static int32_t preadSync(struct sFileIO *io, u_int32_t wait) {
+	return syncFD(io->fd, wait);
+}
+
+static int32_t preadClose(struct sFileIO *io) {
+	if (close(io->fd) != 0) {
+		stderror();
+		return -1;
+	}
+
+	return 0;
+}
+
+static int32_t memoryOpen(struct sFileIO *io) {
+/*
+	reads the whole device into memory
+*/
+	struct sMemoryIO *mem;
+
+	if ((off_t) (size_t) io->size != io->size) {
+		myerror("Device is too large to be held in memory!");
+		return -1;
+	}
+
+	if ((mem=malloc(sizeof(struct sMemoryIO))) == NULL) {
+		stderror();
+		return -1;
+	}
+	if ((mem->data=malloc(MAX(io->size, 1))) == NULL) {
+		stderror();
+		free(mem);
+		return -1;
+	}
+	if (preadFull(io->fd, mem->data, io->size, 0) != io->size) {
+		myerror("Failed to read device into memory!");
+		free(mem->data);
+		free(mem);
+		return -1;
+	}
+	mem->dirty.count=0;
+	io->state=mem;
+
+	return 0;
+}
+
+static ssize_t memoryReadAt(struct sFileIO *io, void *buf, size_t size, off_t offset) {
+	struct sMemoryIO *mem=io->state;
+
+	if (offset >= io->size) return 0;
+	size=MIN((off_t) size, io->size - offset);
+	memcpy(buf, mem->data + offset, size);
+
+	return size;
+}
+
+static ssize_t memoryWriteAt(struct sFileIO *io, const void *buf, size_t size, off_t offset) {
+	struct sMemoryIO *mem=io->state;
+
+	if (!io->writable) {
+		errno=EBADF;
+		return -1;
+	}
+
+	// the device does not grow
+	if (offset >= io->size) return 0;
+	size=MIN((off_t) size, io->size - offset);
+	memcpy(mem->data + offset, buf, size);
+
+	addDirtyRange(&mem->dirty, offset, offset + (off_t) size);
+
+	return size;
+}
+
+static int32_t memoryFlush(struct sFileIO *io) {
+/*
+	writes the dirty ranges back to the device, each one separately
+*/
+	struct sMemoryIO *mem=io->state;
+	u_int32_t i;
+
+	for (i=0; i < mem->dirty.count; i++) {
+		if (pwriteFull(io->fd, mem->data + mem->dirty.range[i].start,
+				mem->dirty.range[i].end - mem->dirty.range[i].start,
+				mem->dirty.range[i].start) != mem->dirty.range[i].end - mem->dirty.range[i].start) {
+			myerror("Could not write back memory image!");
+			return -1;
+		}
+	}
+	mem->dirty.count=0;
+
+	return 0;
+}
+
+static int32_t memorySync(struct sFileIO *io, u_int32_t wait) {
+	if (memoryFlush(io)) return -1;
 
-int fs_seek(FILE *stream, off_t offset, int whence) {
-	return fseeko(stream, offset, whence);
+	return syncFD(io->fd, wait);
 }
 
-off_t fs_read(void *ptr, u_int32_t size, u_int32_t n, FILE *stream) {
-	return fread(ptr, size, n, stream);
+static const void *memoryMapAt(struct sFileIO *io, off_t offset, size_t size) {
+	struct sMemoryIO *mem=io->state;
+
+	(void) size;
+
+	return mem->data + offset;
+}
+
+static int32_t memoryClose(struct sFileIO *io) {
+	struct sMemoryIO *mem=io->state;
+	int32_t ret;
+
+	ret=memoryFlush(io);
+	free(mem->data);
+	free(mem);
+	if (close(io->fd) != 0) {
+		stderror();
+		return -1;
+	}
+
+	return ret;
+}
+
+static int32_t mmapOpen(struct sFileIO *io) {
+/*
+	maps the whole image file, only regular files can be mapped reliably
+*/
+	struct sMmapIO *map;
+	struct stat st;
+
+	if (fstat(io->fd, &st) != 0) {
+		stderror();
+		return -1;
+	}
+	if (!S_ISREG(st.st_mode)) {
+		myerror("The mmap backend needs an image file!");
+		return -1;
+	}
+	if (((off_t) (size_t) io->size != io->size) || (io->size == 0)) {
+		myerror("Image file can not be mapped!");
+		return -1;
+	}
+
+	if ((map=malloc(sizeof(struct sMmapIO))) == NULL) {
+		stderror();
+		return -1;
+	}
+	map->data=mmap(NULL, io->size, io->writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, io->fd, 0);
+	if (map->data == MAP_FAILED) {
+		stderror();
+		free(map);
+		return -1;
+	}
+	map->dirty.count=0;
+	io->state=map;
+
+	return 0;
+}
+
+static ssize_t mmapReadAt(struct sFileIO *io, void *buf, size_t size, off_t offset) {
+	struct sMmapIO *map=io->state;
+
+	if (offset >= io->size) return 0;
+	size=MIN((off_t) size, io->size - offset);
+	memcpy(buf, map->data + offset, size);
+
+	return size;
+}
+
+static ssize_t mmapWriteAt(struct sFileIO *io, const void *buf, size_t size, off_t offset) {
+	struct sMmapIO *map=io->state;
+	off_t page=sysconf(_SC_PAGESIZE);
+
+	if (!io->writable) {
+		errno=EBADF;
+		return -1;
+	}
+
+	// the image file does not grow
+	if (offset >= io->size) return 0;
+	size=MIN((off_t) size, io->size - offset);
+	memcpy(map->data + offset, buf, size);
+
+	addDirtyRange(&map->dirty, offset / page * page, MIN((offset + (off_t) size + page - 1) / page * page, io->size));
+
+	return size;
+}
+
+static const void *mmapMapAt(struct sFileIO *io, off_t offset, size_t size) {
+	struct sMmapIO *map=io->state;
+
+	(void) size;
+
+	return map->data + offset;
+}
+
+static void mmapAdvise(struct sFileIO *io, off_t offset, size_t size, u_int32_t pattern) {
+/*
+	madvise needs page aligned addresses
+*/
+	struct sMmapIO *map=io->state;
+	off_t page=sysconf(_SC_PAGESIZE);
+	off_t start=offset / page * page;
+
+	size+=offset - start;
+	if (pattern == IO_ACCESS_SEQUENTIAL) {
+		madvise(map->data + start, size, MADV_SEQUENTIAL);
+		madvise(map->data + start, size, MADV_WILLNEED);
+	} else {
+		madvise(map->data + start, size, MADV_RANDOM);
+	}
+}
+
+static int32_t mmapFlush(struct sFileIO *io) {
+/*
+	writes go to the shared mapping directly, nothing to do
+*/
+	(void) io;
+
+	return 0;
 }
 
-off_t fs_write(const void *ptr, u_int32_t size, u_int32_t n, FILE *stream) {
-	return fwrite(ptr, size, n, stream);
+static int32_t mmapSync(struct sFileIO *io, u_int32_t wait) {
+/*
+	syncs the dirty ranges, waits for the writes to complete if wait is set
+*/
+	struct sMmapIO *map=io->state;
+	u_int32_t i;
+
+	for (i=0; i < map->dirty.count; i++) {
+		if (msync(map->data + map->dirty.range[i].start, map->dirty.range[i].end - map->dirty.range[i].start,
+				wait ? MS_SYNC : MS_ASYNC) != 0) {
+			myerror("Could not sync mapping!");
+			return -1;
+		}
+	}
+	if (!wait) return syncFD(io->fd, 0);
+	map->dirty.count=0;
+
+	return 0;
 }
 
-int fs_close(FILE* file) {
-	return fclose(file);
+static int32_t mmapClose(struct sFileIO *io) {
+/*
+	unmapping hands all writes to the operating system
+*/
+	struct sMmapIO *map=io->state;
+
+	munmap(map->data, io->size);
+	free(map);
+	if (close(io->fd) != 0) {
+		stderror();
+		return -1;
+	}
+
+	return 0;
 }
 
+static int32_t uringOpen(struct sFileIO *io) {
+/*
+	sets up the ring, falls back to pread and pwrite if the kernel has no io_uring
+*/
+	if ((io->state=newURing(io->queueDepth)) == NULL) {
+		myerror("WARNING: io_uring is not available (%s), using pread instead!", strerror(errno));
+		io->backend=getIOBackend("pread");
+		return io->backend->open(io);
+	}
+
+	return 0;
+}
+
+static int32_t uringReadBatch(struct sFileIO *io, struct sIORequest *reqs, u_int32_t count) {
+	return uringTransfer(io->state, io->fd, reqs, count, 0);
+}
+
+static int32_t uringWriteBatch(struct sFileIO *io, struct sIORequest *reqs, u_int32_t count) {
+	if (!io->writable) {
+		errno=EBADF;
+		return -1;
+	}
+
+	return uringTransfer(io->state, io->fd, reqs, count, 1);
+}
+
+static int32_t uringClose(struct sFileIO *io) {
+	freeURing(io->state);
+
+	return preadClose(io);
+}
+
+// stdio streams, the historic implementation
+static const struct sIOBackend stdioBackend = {
+	"stdio", stdioOpen, stdioReadAt, stdioWriteAt, NULL, NULL,
+	stdioFlush, stdioSync, stdioClose, NULL, NULL, NULL, NULL
+};
+
+// pread/pwrite without a shared file offset, transfers may run in several threads at once
+static const struct sIOBackend preadBackend = {
+	"pread", preadOpen, preadReadAt, preadWriteAt, preadReadvAt, preadWritevAt,
+	preadFlush, preadSync, preadClose, NULL, preadAdvise, NULL, NULL
+};
+
+// whole device in memory, written back on flush
+static const struct sIOBackend memoryBackend = {
+	"memory", memoryOpen, memoryReadAt, memoryWriteAt, NULL, NULL,
+	memoryFlush, memorySync, memoryClose, memoryMapAt, NULL, NULL, NULL
+};
+
+// shared mapping of an image file, written ranges are synced with msync
+static const struct sIOBackend mmapBackend = {
+	"mmap", mmapOpen, mmapReadAt, mmapWriteAt, NULL, NULL,
+	mmapFlush, mmapSync, mmapClose, mmapMapAt, mmapAdvise, NULL, NULL
+};
+
+// batches go through io_uring with up to queueDepth transfers in flight,
+// single transfers use pread and pwrite
+static const struct sIOBackend uringBackend = {
+	"uring", uringOpen, preadReadAt, preadWriteAt, preadReadvAt, preadWritevAt,
+	preadFlush, preadSync, uringClose, NULL, preadAdvise, uringReadBatch, uringWriteBatch
+};
+
+static const struct sIOBackend *IOBackends[] = {
+	&preadBackend,
+	&stdioBackend,
+	&memoryBackend,
+	&mmapBackend,
+	&uringBackend,
+	NULL
+};
+
+const struct sIOBackend *getIOBackend(const char *name) {
+/*
+	returns the backend with the given name or the default backend if name is NULL
+*/
+	u_int32_t i;
+
+	if (name == NULL) name=DEFAULT_IO_BACKEND;
+
+	for (i=0; IOBackends[i] != NULL; i++) {
+		if (strcmp(IOBackends[i]->name, name) == 0) return IOBackends[i];
+	}
+
+	return NULL;
+}
+
+void setIOQueueDepth(u_int32_t depth) {
+	IOQueueDepth=depth;
+}
+
+int32_t fs_open(struct sFileIO *io, const struct sIOBackend *backend, int32_t fd, u_int32_t writable) {
+/*
+	attaches backend to the open file descriptor fd,
+	the caller still has to close fd if this fails
+*/
+	io->backend=backend;
+	io->fd=fd;
+	io->writable=writable;
+	io->queueDepth=IOQueueDepth;
+	io->state=NULL;
+
+	if ((io->size=lseek(fd, 0, SEEK_END)) == -1) {
+		stderror();
+		return -1;
+	}
+
+	return backend->open(io);
+}
+
+ssize_t fs_readAt(struct sFileIO *io, void *buf, size_t size, off_t offset) {
+	return io->backend->readAt(io, buf, size, offset);
+}
+
+ssize_t fs_writeAt(struct sFileIO *io, const void *buf, size_t size, off_t offset) {
+	return io->backend->writeAt(io, buf, size, offset);
+}
+
+ssize_t fs_readvAt(struct sFileIO *io, const struct iovec *iov, int32_t count, off_t offset) {
+/*
+	backends without vectored reads get one read per buffer
+*/
+	int32_t i;
+	ssize_t n, done=0;
+
+	if (io->backend->readvAt != NULL) return io->backend->readvAt(io, iov, count, offset);
+
+	for (i=0; i < count; i++) {
+		n=io->backend->readAt(io, iov[i].iov_base, iov[i].iov_len, offset + done);
+		if (n == -1) return -1;
+		done+=n;
+		if ((size_t) n < iov[i].iov_len) break;
+	}
+
+	return done;
+}
+
+ssize_t fs_writevAt(struct sFileIO *io, const struct iovec *iov, int32_t count, off_t offset) {
+/*
+	backends without vectored writes get one write per buffer
+*/
+	int32_t i;
+	ssize_t n, done=0;
+
+	if (io->backend->writevAt != NULL) return io->backend->writevAt(io, iov, count, offset);
+
+	for (i=0; i < count; i++) {
+		n=io->backend->writeAt(io, iov[i].iov_base, iov[i].iov_len, offset + done);
+		if (n == -1) return -1;
+		done+=n;
+		if ((size_t) n < iov[i].iov_len) break;
+	}
+
+	return done;
+}
+
+int32_t fs_readBatch(struct sFileIO *io, struct sIORequest *reqs, u_int32_t count) {
+/*
+	backends without batches transfer one request after the other
+*/
+	u_int32_t i;
+
+	if (io->backend->readBatch != NULL) return io->backend->readBatch(io, reqs, count);
+
+	for (i=0; i < count; i++) {
+		if (io->backend->readAt(io, reqs[i].buf, reqs[i].size, reqs[i].offset) != (ssize_t) reqs[i].size) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int32_t fs_writeBatch(struct sFileIO *io, struct sIORequest *reqs, u_int32_t count) {
+/*
+	backends without batches transfer one request after the other
+*/
+	u_int32_t i;
+
+	if (io->backend->writeBatch != NULL) return io->backend->writeBatch(io, reqs, count);
+
+	for (i=0; i < count; i++) {
+		if (io->backend->writeAt(io, reqs[i].buf, reqs[i].size, reqs[i].offset) != (ssize_t) reqs[i].size) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+u_int32_t fs_batchSize(struct sFileIO *io) {
+	return (io->backend->readBatch != NULL) ? MAX(io->queueDepth, 1) : 1;
+}
+
+const void *fs_mapAt(struct sFileIO *io, off_t offset, size_t size) {
+	if ((io->backend->mapAt == NULL) || (offset < 0) || (offset > io->size) ||
+	    ((off_t) size > io->size - offset)) {
+		return NULL;
+	}
+
+	return io->backend->mapAt(io, offset, size);
+}
+
+void fs_advise(struct sFileIO *io, off_t offset, size_t size, u_int32_t pattern) {
+	if (io->backend->advise != NULL) io->backend->advise(io, offset, size, pattern);
+}
+
+int32_t fs_flush(struct sFileIO *io) {
+	return io->backend->flush(io);
+}
+
+int32_t fs_sync(struct sFileIO *io, u_int32_t wait) {
+	return io->backend->sync(io, wait);
+}
+
+int32_t fs_close(struct sFileIO *io) {
+	return io->backend->close(io);
+}
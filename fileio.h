@@ -26,11 +26,97 @@
 
 #include <stdio.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include "platform.h"
 
-int fs_seek(FILE *stream, off_t offset, int whence);
-off_t fs_read(void *ptr, u_int32_t size, u_int32_t n, FILE *stream);
-off_t fs_write(const void *ptr, u_int32_t size, u_int32_t n, FILE *stream);
-int fs_close(FILE* file);
+// name of the I/O backend that is used if none is selected
+#define DEFAULT_IO_BACKEND "pread"
+
+// transfers a batching backend keeps in flight unless set otherwise
+#define DEFAULT_IO_QUEUE_DEPTH 32
+#define MAX_IO_QUEUE_DEPTH 4096
+
+// expected access patterns of a region for fs_advise
+#define IO_ACCESS_SEQUENTIAL 1	// read front to back soon, e.g. the FATs
+#define IO_ACCESS_RANDOM 2	// read piecemeal in no particular order, e.g. directories
+
+struct sFileIO;
+
+// one positional transfer of a batch
+struct sIORequest {
+	void *buf;
+	size_t size;
+	off_t offset;
+};
+
+// operations of an I/O backend, all offsets are absolute byte offsets on the device;
+// transfers return the count of bytes transferred (less on end of file) or -1 on error
+struct sIOBackend {
+	const char *name;
+	int32_t (*open)(struct sFileIO *io);
+	ssize_t (*readAt)(struct sFileIO *io, void *buf, size_t size, off_t offset);
+	ssize_t (*writeAt)(struct sFileIO *io, const void *buf, size_t size, off_t offset);
+	ssize_t (*readvAt)(struct sFileIO *io, const struct iovec *iov, int32_t count, off_t offset);
+	ssize_t (*writevAt)(struct sFileIO *io, const struct iovec *iov, int32_t count, off_t offset);
+	int32_t (*flush)(struct sFileIO *io);
+	int32_t (*sync)(struct sFileIO *io, u_int32_t wait);
+	int32_t (*close)(struct sFileIO *io);
+	const void *(*mapAt)(struct sFileIO *io, off_t offset, size_t size);	// optional
+	void (*advise)(struct sFileIO *io, off_t offset, size_t size, u_int32_t pattern);	// optional
+	int32_t (*readBatch)(struct sFileIO *io, struct sIORequest *reqs, u_int32_t count);	// optional
+	int32_t (*writeBatch)(struct sFileIO *io, struct sIORequest *reqs, u_int32_t count);	// optional
+};
+
+// an open device or image file
+struct sFileIO {
+	const struct sIOBackend *backend;
+	int32_t fd;		// file descriptor, owned by the backend once opened
+	u_int32_t writable;
+	off_t size;		// size of the device or image file
+	u_int32_t queueDepth;	// transfers a batching backend keeps in flight
+	void *state;		// private data of the backend
+};
+
+// returns the backend with the given name or the default backend if name is NULL,
+// returns NULL for unknown names
+const struct sIOBackend *getIOBackend(const char *name);
+
+// sets the queue depth for file systems opened from now on
+void setIOQueueDepth(u_int32_t depth);
+
+// attaches backend to the open file descriptor fd
+int32_t fs_open(struct sFileIO *io, const struct sIOBackend *backend, int32_t fd, u_int32_t writable);
+
+// read or write size bytes at offset
+ssize_t fs_readAt(struct sFileIO *io, void *buf, size_t size, off_t offset);
+ssize_t fs_writeAt(struct sFileIO *io, const void *buf, size_t size, off_t offset);
+
+// read or write count buffers from or to consecutive bytes at offset
+ssize_t fs_readvAt(struct sFileIO *io, const struct iovec *iov, int32_t count, off_t offset);
+ssize_t fs_writevAt(struct sFileIO *io, const struct iovec *iov, int32_t count, off_t offset);
+
+// transfer all requests of a batch, possibly concurrently and in any order,
+// returns 0 once all of them completed in full and -1 otherwise
+int32_t fs_readBatch(struct sFileIO *io, struct sIORequest *reqs, u_int32_t count);
+int32_t fs_writeBatch(struct sFileIO *io, struct sIORequest *reqs, u_int32_t count);
+
+// returns how many requests are worth passing to one batch, 1 if the backend has no batches
+u_int32_t fs_batchSize(struct sFileIO *io);
+
+// returns a pointer to size bytes at offset that is valid until close and reflects later writes,
+// returns NULL if the backend does not hold the device in memory
+const void *fs_mapAt(struct sFileIO *io, off_t offset, size_t size);
+
+// hint how a region of the device will be accessed
+void fs_advise(struct sFileIO *io, off_t offset, size_t size, u_int32_t pattern);
+
+// pass buffered writes to the operating system
+int32_t fs_flush(struct sFileIO *io);
+
+// flush and sync to the device, only start writeback if wait is zero
+int32_t fs_sync(struct sFileIO *io, u_int32_t wait);
+
+// flush and close, closes the file descriptor too
+int32_t fs_close(struct sFileIO *io);
 
 #endif	// __fileio_h__
@@ -26,7 +26,7 @@
 #include <assert.h>
 #include <string.h>
 #include <stdio.h>
-#include <ctype.h>
+#include <limits.h>
 #include "mallocv.h"
 
 int32_t isDigit(const char c) {
@@ -38,72 +38,55 @@ int32_t isDigit(const char c) {
 	return 0;
 }
 
-int32_t parseNumber(char **s) {
+char natCharKey(const char c) {
 /*
-	parse integer in string s
+	map character to key byte, so that byte-wise comparison of keys
+	gives the same order as comparing the characters as char
 */
-	int32_t value=0;
-
-	if (!isDigit(**s)) return -1;
-
-	while(isDigit(**s)) {
-		value=value*10 + **s -'0';
-		(*s)++;
-	}
-
-	return value;
+	return (char) ((int) c - CHAR_MIN);
 }
 
-int32_t natstrcompare(const char *str1, const char *str2, const u_int32_t respectCase) {
+size_t natstrkey(const char *str, char *key) {
 /*
-	natural order string compare
+	encode str as natural order key, key must hold 2*strlen(str)+1 bytes.
+	Digit runs are stored without leading zeros and prefixed with their length,
+	so that byte-wise comparison of keys orders numbers of any length
+	by value. Other characters are kept as they are, case folding is up to
+	the caller. Returns the length of the key, which may contain '\0' bytes.
 */
-	assert(str1 != NULL);
-	assert(str2 != NULL);
-
-	int32_t n1=0, n2=0;
-	char *s1 = (char *) str1;
-	char *s2 = (char *) str2;
-
-	while(1) {
- 		//printf("Strings: %s %s\n", s1, s2);
-
-		if ((*s1 == '\0') || (*s2 == '\0')) {
-			return strcmp(s1, s2);
+	assert(str != NULL);
+	assert(key != NULL);
+
+	const char *s=str, *digits;
+	char *k=key;
+	size_t len;
+
+	while (*s != '\0') {
+		if (isDigit(*s)) {
+			while (*s == '0') s++;
+			digits=s;
+			while (isDigit(*s)) s++;
+			len=s-digits;
+
+			// short numbers need a single length byte
+			if (len < 9) {
+				*k++=natCharKey('0' + len);
+			} else {
+				*k++=natCharKey('9');
+				*k++=(len >> 24) & 0xff;
+				*k++=(len >> 16) & 0xff;
+				*k++=(len >> 8) & 0xff;
+				*k++=len & 0xff;
+			}
+			while (digits < s) {
+				*k++=natCharKey(*digits++);
+			}
+		} else {
+			*k++=natCharKey(*s);
+			s++;
 		}
-
-		// compare characters until the first digit occurs
-		while (1) {
-			if (isDigit(*s1) || isDigit(*s2)) break;
-			else if ((*s1 == '\0') && (*s2 == '\0')) return 0;
-			else if ((*s2 == '\0') ||
-				(respectCase ? toupper(*s1) > toupper(*s2) : *s1 > *s2)) return 1;
-			else if ((*s1 == '\0') ||
-				(respectCase ? toupper(*s1) < toupper(*s2) : *s1 < *s2)) return -1;
-			s1++; s2++;
-		}
-
-		// at least one of the strings has a number in it
-		n1=parseNumber(&s1);
-		n2=parseNumber(&s2);
-
- 		//printf("Numbers: %d %d\n", n1, n2);
-
-		// one of the strings had no number
-		if ((n1 == -1) || (n2 == -1)) {
-			if      ((*s1 == '\0') && (n1 == -1)) return -1;
-			else if ((*s1 == '\0') && (n2 == -1)) return '0' < *s2 ? -1 : 1;
-			else if ((*s2 == '\0') && (n1 == -1)) return '0' < *s1 ? 1 : -1;
-			else if ((*s2 == '\0') && (n2 == -1)) return 1;
-		// both strings had numbers in it
-		} else if (n1 != n2) return n1 > n2 ? 1 : -1;	
 	}
-}
-
-int32_t natstrcmp(const char *str1, const char *str2) {
-	return natstrcompare(str1, str2, 0);
-}
+	*k='\0';
 
-int32_t natstrcasecmp(const char *str1, const char *str2) {
-	return natstrcompare(str1, str2, 1);
+	return k-key;
 }
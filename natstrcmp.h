@@ -25,11 +25,9 @@
 #define __natstrcmp_h__
 
 #include <sys/types.h>
+#include <stddef.h>
 
-// natural order comparison
-int32_t natstrcmp(const char *str1, const char *str2);
-
-// natural order comparison ignoring case
-int32_t natstrcasecmp(const char *str1, const char *str2);
+// encode str as natural order key for byte-wise comparison
+size_t natstrkey(const char *str, char *key);
 
 #endif // __natstrcmp_h__
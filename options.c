@@ -24,17 +24,27 @@
 #include "options.h"
 
 #include <getopt.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
 #include <assert.h>
 #include <errno.h>
 #include "errors.h"
 #include "stringlist.h"
 #include "regexlist.h"
+#include "fileio.h"
 #include "mallocv.h"
 
 u_int32_t OPT_VERSION, OPT_HELP, OPT_INFO, OPT_QUIET, OPT_IGNORE_CASE,
 	OPT_ORDER, OPT_LIST, OPT_REVERSE, OPT_FORCE, OPT_NATURAL_SORT,
 	OPT_RECURSIVE, OPT_RANDOM, OPT_MORE_INFO, OPT_MODIFICATION,
-	OPT_ASCII, OPT_REGEX;
+	OPT_ASCII, OPT_REGEX, OPT_SYNC, OPT_SYNC_INTERVAL;
+
+u_int64_t OPT_SEED;
+
+const struct sIOBackend *OPT_IO_BACKEND;
+
+char *OPT_SORT_KEYS;
 
 struct sStringList *OPT_INCL_DIRS = NULL;
 struct sStringList *OPT_EXCL_DIRS = NULL;
@@ -137,11 +147,17 @@ int32_t parse_options(int argc, char *argv[]) {
 */
 
 	int8_t c;
+	char *end;
+	u_int32_t i;
+	unsigned long depth, interval;
 
 	static struct option longOpts[] = {
 		// name, has_arg, flag, val
 		{"help", 0, 0, 'h'},
 		{"version", 0, 0, 'v'},
+		{"seed", 1, 0, 'S'},
+		{"io", 1, 0, 'B'},
+		{"io-depth", 1, 0, 'Q'},
 		{0, 0, 0, 0}
 	};
 
@@ -158,6 +174,12 @@ int32_t parse_options(int argc, char *argv[]) {
 	// random sort order
 	OPT_RANDOM = 0;
 
+	// seed for random sort order, differs from run to run by default
+	OPT_SEED = (u_int64_t) time(0) ^ ((u_int64_t) getpid() << 32);
+
+	// positional I/O by default
+	OPT_IO_BACKEND = getIOBackend(NULL);
+
 	// default order (directories first)
 	OPT_ORDER = 0;
 
@@ -173,9 +195,16 @@ int32_t parse_options(int argc, char *argv[]) {
 	// sort by last modification time
 	OPT_MODIFICATION = 0;
 
+	// sort keys, name or modification time (-t) by default
+	OPT_SORT_KEYS = NULL;
+
 	// sort by using locale collation order
 	OPT_ASCII = 0;
 
+	// sync after every written directory
+	OPT_SYNC = SYNC_DIRS;
+	OPT_SYNC_INTERVAL = 1;
+
 	// default locale from environment
 	OPT_LOCALE = malloc(1);
 	if (OPT_LOCALE == NULL) {
@@ -225,7 +254,7 @@ int32_t parse_options(int argc, char *argv[]) {
 	}
 
 	opterr=0;
-	while ((c=getopt_long(argc, argv, "imvhqcfo:lrRnd:D:x:X:I:taL:e:E:", longOpts, NULL)) != -1) {
+	while ((c=getopt_long(argc, argv, "imvhqcfo:lrRnd:D:x:X:I:taL:e:E:s:k:", longOpts, NULL)) != -1) {
 		switch(c) {
 			case 'a' : OPT_ASCII = 1; break;
 			case 'c' : OPT_IGNORE_CASE = 1; break;
@@ -246,6 +275,37 @@ int32_t parse_options(int argc, char *argv[]) {
 						return -1;
 				}
 				break;
+			case 's' :
+				switch(optarg[0]) {
+					case 'd': OPT_SYNC=SYNC_DIRS; OPT_SYNC_INTERVAL=1; break;
+					case 'b': OPT_SYNC=SYNC_BYTES; OPT_SYNC_INTERVAL=16*1024*1024; break;
+					case 'e': OPT_SYNC=SYNC_END; break;
+#if defined(__LINUX__)
+					case 'r': OPT_SYNC=SYNC_RANGE; break;
+#endif
+					default:
+						myerror("Unknown flag '%c' for option 's'.", optarg[0]);
+						myerror("Use -h for more help.");
+						freeOptions();
+						return -1;
+				}
+				if ((optarg[1] != '\0') && ((OPT_SYNC == SYNC_END) || (OPT_SYNC == SYNC_RANGE))) {
+					myerror("Flag '%c' for option 's' takes no interval.", optarg[0]);
+					freeOptions();
+					return -1;
+				}
+				if (optarg[1] != '\0') {
+					errno=0;
+					interval=strtoul(optarg+1, &end, 10);
+					if ((optarg[1] < '0') || (optarg[1] > '9') || (errno != 0) || (*end != '\0') ||
+					    (interval == 0) || ((u_int32_t) interval != interval)) {
+						myerror("Invalid interval '%s' for option 's'.", optarg+1);
+						freeOptions();
+						return -1;
+					}
+					OPT_SYNC_INTERVAL=interval;
+				}
+				break;
 			case 'd' :
 				if (addDirPathToStringList(OPT_INCL_DIRS, (const char(*)[MAX_PATH_LEN+1]) optarg)) {
 					myerror("Could not add directory path to dirPathList");
@@ -297,10 +357,55 @@ int32_t parse_options(int argc, char *argv[]) {
 					return -1;
 				}
 				break;
+			case 'k' :
+				// a sequence of different keys, the name must be the last key
+				for (i=0; optarg[i] != '\0'; i++) {
+					if (((optarg[i] != SORT_KEY_TIME) && (optarg[i] != SORT_KEY_NAME)) ||
+					    (strchr(optarg + i + 1, optarg[i]) != NULL) ||
+					    ((optarg[i] == SORT_KEY_NAME) && (optarg[i+1] != '\0'))) {
+						myerror("Invalid sort keys '%s'.", optarg);
+						myerror("Use -h for more help.");
+						freeOptions();
+						return -1;
+					}
+				}
+				if (i == 0) {
+					myerror("Sort keys must not be empty.");
+					freeOptions();
+					return -1;
+				}
+				OPT_SORT_KEYS = optarg;
+				break;
 			case 'n' : OPT_NATURAL_SORT = 1; break;
 			case 'q' : OPT_QUIET = 1; break;
 			case 'r' : OPT_REVERSE = -1; break;
 			case 'R' : OPT_RANDOM = 1; break;
+			case 'S' :
+				errno=0;
+				OPT_SEED = strtoull(optarg, &end, 0);
+				if ((errno != 0) || (end == optarg) || (*end != '\0')) {
+					myerror("Invalid seed '%s'!", optarg);
+					freeOptions();
+					return -1;
+				}
+			break;
+			case 'B' :
+				if ((OPT_IO_BACKEND=getIOBackend(optarg)) == NULL) {
+					myerror("Unknown I/O backend '%s'!", optarg);
+					freeOptions();
+					return -1;
+				}
+			break;
+			case 'Q' :
+				errno=0;
+				depth = strtoul(optarg, &end, 0);
+				if ((errno != 0) || (end == optarg) || (*end != '\0') || (depth < 1) || (depth > MAX_IO_QUEUE_DEPTH)) {
+					myerror("Invalid queue depth '%s'!", optarg);
+					freeOptions();
+					return -1;
+				}
+				setIOQueueDepth(depth);
+			break;
       case 't' : OPT_MODIFICATION = 1; break;
 			case 'v' : OPT_VERSION = 1; break;
 			case 'L' :
@@ -30,10 +30,24 @@
 #include "stringlist.h"
 #include "regexlist.h"
 
+// sync policies for written directories
+#define SYNC_DIRS 0	// sync after every OPT_SYNC_INTERVAL directories
+#define SYNC_BYTES 1	// sync after OPT_SYNC_INTERVAL written bytes
+#define SYNC_END 2	// sync once at the end
+#define SYNC_RANGE 3	// start writeback after every directory, sync at the end
+
+// sort keys for option -k
+#define SORT_KEY_TIME 't'	// last modification date and time
+#define SORT_KEY_NAME 'n'	// name, must be the last key
+#define MAX_SORT_KEYS 2
+
 extern u_int32_t OPT_VERSION, OPT_HELP, OPT_INFO, OPT_QUIET, OPT_IGNORE_CASE,
 		OPT_ORDER, OPT_LIST, OPT_REVERSE, OPT_FORCE, OPT_NATURAL_SORT,
 		OPT_RECURSIVE, OPT_RANDOM, OPT_MORE_INFO, OPT_MODIFICATION,
-		OPT_ASCII, OPT_REGEX;
+		OPT_ASCII, OPT_REGEX, OPT_SYNC, OPT_SYNC_INTERVAL;
+extern u_int64_t OPT_SEED;
+extern const struct sIOBackend *OPT_IO_BACKEND;
+extern char *OPT_SORT_KEYS;
 extern struct sStringList *OPT_INCL_DIRS, *OPT_EXCL_DIRS, *OPT_INCL_DIRS_REC, *OPT_EXCL_DIRS_REC, *OPT_IGNORE_PREFIXES_LIST;
 extern struct sRegExList *OPT_REGEX_INCL, *OPT_REGEX_EXCL;
 
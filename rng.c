@@ -0,0 +1,92 @@
+/*
+	FATSort, utility for sorting FAT directory structures
+	Copyright (C) 2004 Boris Leidner <fatsort(at)formenos.de>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+	This file contains/describes a small seedable pseudo random number generator.
+	It implements xoshiro256** by David Blackman and Sebastiano Vigna, which is
+	seeded with splitmix64, so that the same seed always gives the same numbers.
+*/
+
+#include "rng.h"
+
+#include <assert.h>
+#include "mallocv.h"
+
+static u_int64_t state[4];
+
+static inline u_int64_t rotl(const u_int64_t x, int k) {
+	return (x << k) | (x >> (64 - k));
+}
+
+void seedRandom(u_int64_t seed) {
+/*
+	seed the random number generator
+*/
+	u_int32_t i;
+	u_int64_t z;
+
+	// splitmix64 never produces an all zero state
+	for (i=0; i < 4; i++) {
+		seed += 0x9e3779b97f4a7c15ULL;
+		z = seed;
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		state[i] = z ^ (z >> 31);
+	}
+}
+
+u_int64_t nextRandom(void) {
+/*
+	next 64 bit pseudo random number
+*/
+	const u_int64_t result = rotl(state[1] * 5, 7) * 9;
+	const u_int64_t t = state[1] << 17;
+
+	state[2] ^= state[0];
+	state[3] ^= state[1];
+	state[1] ^= state[2];
+	state[0] ^= state[3];
+
+	state[2] ^= t;
+
+	state[3] = rotl(state[3], 45);
+
+	return result;
+}
+
+u_int32_t randomBelow(u_int32_t n) {
+/*
+	uniformly distributed pseudo random number in [0, n)
+*/
+	assert(n > 0);
+
+	u_int64_t m;
+	u_int32_t threshold;
+
+	// multiply and shift instead of modulo, reject the few biased values
+	m = (nextRandom() >> 32) * n;
+	if ((u_int32_t) m < n) {
+		threshold = -n % n;
+		while ((u_int32_t) m < threshold) {
+			m = (nextRandom() >> 32) * n;
+		}
+	}
+
+	return m >> 32;
+}
@@ -0,0 +1,38 @@
+/*
+	FATSort, utility for sorting FAT directory structures
+	Copyright (C) 2004 Boris Leidner <fatsort(at)formenos.de>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+	This file contains/describes a small seedable pseudo random number generator.
+*/
+
+#ifndef __rng_h__
+#define __rng_h__
+
+#include <sys/types.h>
+
+// seed the random number generator
+void seedRandom(u_int64_t seed);
+
+// next 64 bit pseudo random number
+u_int64_t nextRandom(void);
+
+// uniformly distributed pseudo random number in [0, n)
+u_int32_t randomBelow(u_int32_t n);
+
+#endif // __rng_h__
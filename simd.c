@@ -0,0 +1,183 @@
+/*
+	FATSort, utility for sorting FAT directory structures
+	Copyright (C) 2004 Boris Leidner <fatsort(at)formenos.de>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+	This file contains/describes the runtime selection of vectorized kernels.
+*/
+
+#include "simd.h"
+
+#include <string.h>
+#include <assert.h>
+#include "FAT_fs.h"
+#include "dirscan.h"
+#include "fatscan.h"
+#include "errors.h"
+#include "mallocv.h"
+
+// number of FAT entries used by the self-test, not a multiple of any vector width
+#define SELFTEST_FAT_ENTRIES 1029
+
+u_int32_t detectCPUFeatures(void) {
+/*
+	detects the vector extensions of the cpu
+*/
+	u_int32_t features=0;
+
+#ifdef HAVE_X86_KERNELS
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2")) features|=CPU_FEATURE_SSE2;
+	if (__builtin_cpu_supports("ssse3")) features|=CPU_FEATURE_SSSE3;
+	if (__builtin_cpu_supports("avx2")) features|=CPU_FEATURE_AVX2;
+#endif
+
+	return features;
+}
+
+#ifdef HAVE_X86_KERNELS
+static u_int32_t testRandom(u_int32_t *state) {
+/*
+	fixed xorshift sequence for the self-test input
+*/
+	*state^=*state << 13;
+	*state^=*state >> 17;
+	*state^=*state << 5;
+	return *state;
+}
+
+static int32_t testClassifyDirEntries(void (*variant)(const union sDirEntry *, u_int32_t, struct sDirEntryClass *)) {
+/*
+	cross-checks a variant of classifyDirEntries with the reference implementation,
+	returns 0 if both agree
+*/
+	union sDirEntry de[DIR_CLASS_BLOCK];
+	struct sDirEntryClass expected, actual;
+	u_char *bytes=(u_char *) de;
+	u_int32_t i, n, state=0x2545f491;
+	static const u_int32_t counts[]={DIR_CLASS_BLOCK, DIR_CLASS_BLOCK-17, 16, 3, 0};
+
+	for (i=0; i<sizeof(de); i++) bytes[i]=(u_char) testRandom(&state);
+	// make sure every kind of entry shows up
+	for (i=0; i<DIR_CLASS_BLOCK; i++) {
+		switch(testRandom(&state) % 5) {
+		case 0: bytes[i*DIR_ENTRY_SIZE]=DE_FOLLOWING_FREE; break;
+		case 1: bytes[i*DIR_ENTRY_SIZE]=DE_FREE; break;
+		case 2: bytes[i*DIR_ENTRY_SIZE+11]=ATTR_LONG_NAME; break;
+		case 3: bytes[i*DIR_ENTRY_SIZE+11]=ATTR_VOLUME_ID; break;
+		}
+	}
+
+	for (i=0; i<sizeof(counts)/sizeof(counts[0]); i++) {
+		n=counts[i];
+		classifyDirEntriesScalar(de, n, &expected);
+		variant(de, n, &actual);
+		if ((expected.end != actual.end) ||
+		    (expected.deleted != actual.deleted) ||
+		    (expected.longName != actual.longName) ||
+		    (expected.shortName != actual.shortName) ||
+		    (expected.volumeLabel != actual.volumeLabel) ||
+		    memcmp(expected.checksum, actual.checksum, n)) return -1;
+	}
+
+	return 0;
+}
+
+static int32_t testDecodeFATEntries(void (*reference)(const u_char *, u_int32_t *, u_int32_t),
+				    void (*variant)(const u_char *, u_int32_t *, u_int32_t)) {
+/*
+	cross-checks a variant of one of the decodeFATxxEntries kernels with its
+	reference implementation, returns 0 if both agree
+*/
+	u_char raw[SELFTEST_FAT_ENTRIES*4];
+	u_int32_t expected[SELFTEST_FAT_ENTRIES], actual[SELFTEST_FAT_ENTRIES];
+	u_int32_t i, state=0x1b873593;
+
+	for (i=0; i<sizeof(raw); i++) raw[i]=(u_char) testRandom(&state);
+
+	reference(raw, expected, SELFTEST_FAT_ENTRIES);
+	variant(raw, actual, SELFTEST_FAT_ENTRIES);
+
+	return memcmp(expected, actual, sizeof(expected)) ? -1 : 0;
+}
+
+static int32_t testMaskFATEntries(void (*variant)(const u_int32_t *, u_int32_t, u_int32_t, u_int64_t *, u_int64_t *)) {
+/*
+	cross-checks a variant of maskFATEntries with the reference implementation,
+	returns 0 if both agree
+*/
+	u_int32_t FAT[SELFTEST_FAT_ENTRIES];
+	u_int32_t i, n, state=0x85ebca6b;
+	u_int64_t expectedFree, expectedBad, actualFree, actualBad;
+
+	for (i=0; i<SELFTEST_FAT_ENTRIES; i++) {
+		switch(testRandom(&state) % 3) {
+		case 0: FAT[i]=0; break;
+		case 1: FAT[i]=0x0ffffff7; break;
+		default: FAT[i]=testRandom(&state) & 0x0fffffff;
+		}
+	}
+
+	// every block size at varying offsets
+	for (n=1; n<=64; n++) {
+		i=(n * 61) % (SELFTEST_FAT_ENTRIES - 64);
+		maskFATEntriesScalar(FAT + i, n, 0x0ffffff7, &expectedFree, &expectedBad);
+		variant(FAT + i, n, 0x0ffffff7, &actualFree, &actualBad);
+		if ((expectedFree != actualFree) || (expectedBad != actualBad)) return -1;
+	}
+
+	return 0;
+}
+
+// binds kernel to its variant if that passes test, keeps the previous binding otherwise
+#define BIND_KERNEL(kernel, variant, test) \
+	if ((test) == 0) { \
+		kernel=kernel##variant; \
+	} else { \
+		myerror("WARNING: " #kernel #variant " failed the self-test and is not used!"); \
+	}
+#endif
+
+void initKernels(u_int32_t features) {
+/*
+	binds the kernels to the fastest variants the cpu supports. Every variant
+	is cross-checked with the reference implementation first, the scalar
+	reference stays in place if no variant passes.
+*/
+
+#ifdef HAVE_X86_KERNELS
+	if (features & CPU_FEATURE_SSE2) {
+		BIND_KERNEL(classifyDirEntries, SSE2, testClassifyDirEntries(classifyDirEntriesSSE2));
+		BIND_KERNEL(decodeFAT16Entries, SSE2, testDecodeFATEntries(decodeFAT16EntriesScalar, decodeFAT16EntriesSSE2));
+		BIND_KERNEL(decodeFAT32Entries, SSE2, testDecodeFATEntries(decodeFAT32EntriesScalar, decodeFAT32EntriesSSE2));
+		BIND_KERNEL(maskFATEntries, SSE2, testMaskFATEntries(maskFATEntriesSSE2));
+	}
+	if (features & CPU_FEATURE_SSSE3) {
+		BIND_KERNEL(decodeFAT12Entries, SSSE3, testDecodeFATEntries(decodeFAT12EntriesScalar, decodeFAT12EntriesSSSE3));
+	}
+	if (features & CPU_FEATURE_AVX2) {
+		BIND_KERNEL(classifyDirEntries, AVX2, testClassifyDirEntries(classifyDirEntriesAVX2));
+		BIND_KERNEL(decodeFAT12Entries, AVX2, testDecodeFATEntries(decodeFAT12EntriesScalar, decodeFAT12EntriesAVX2));
+		BIND_KERNEL(decodeFAT16Entries, AVX2, testDecodeFATEntries(decodeFAT16EntriesScalar, decodeFAT16EntriesAVX2));
+		BIND_KERNEL(decodeFAT32Entries, AVX2, testDecodeFATEntries(decodeFAT32EntriesScalar, decodeFAT32EntriesAVX2));
+		BIND_KERNEL(maskFATEntries, AVX2, testMaskFATEntries(maskFATEntriesAVX2));
+	}
+#else
+	(void) features;
+#endif
+}
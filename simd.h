@@ -0,0 +1,49 @@
+/*
+	FATSort, utility for sorting FAT directory structures
+	Copyright (C) 2004 Boris Leidner <fatsort(at)formenos.de>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+	This file contains/describes the runtime selection of vectorized kernels.
+*/
+
+#ifndef __simd_h__
+#define __simd_h__
+
+#include <sys/types.h>
+
+// vector extensions the kernels can use
+#define CPU_FEATURE_SSE2 0x01
+#define CPU_FEATURE_SSSE3 0x02
+#define CPU_FEATURE_AVX2 0x04
+
+// vectorized variants are built for x86 with gcc compatible compilers,
+// each variant is compiled for its own target and only called if the cpu supports it
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(__BIG_ENDIAN__)
+#define HAVE_X86_KERNELS 1
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+// detect the vector extensions of the cpu
+u_int32_t detectCPUFeatures(void);
+
+// bind the kernels to the fastest variants that pass the self-test
+void initKernels(u_int32_t features);
+
+#endif // __simd_h__
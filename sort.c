@@ -42,54 +42,95 @@
 #include "platform.h"
 #include "stringlist.h"
 #include "mallocv.h"
+#include "unicode.h"
+#include "dirscan.h"
 
-int32_t parseLongFilenamePart(struct sLongDirEntry *lde, char *str, iconv_t cd) {
+// count of directories that were written and count of directories that were already sorted
+u_int32_t writtenDirs, unchangedDirs;
+
+// directories and bytes that were written since the last sync
+u_int32_t unsyncedDirs, unsyncedBytes;
+
+int32_t commitDirectory(struct sFileSystem *fs, u_int32_t bytes) {
+/*
+	makes a written directory durable according to the sync policy.
+	Must be called within the critical section of the write, buffered writes
+	are always flushed, so that a directory is never written partially.
+*/
+	assert(fs != NULL);
+
+	unsyncedDirs++;
+	unsyncedBytes+=bytes;
+
+	switch(OPT_SYNC) {
+	case SYNC_DIRS:
+		if (unsyncedDirs < OPT_SYNC_INTERVAL) return flushFileSystem(fs);
+		break;
+	case SYNC_BYTES:
+		if (unsyncedBytes < OPT_SYNC_INTERVAL) return flushFileSystem(fs);
+		break;
+	case SYNC_END:
+		return flushFileSystem(fs);
+	case SYNC_RANGE:
+		return writebackFileSystem(fs);
+	}
+
+	unsyncedDirs=0;
+	unsyncedBytes=0;
+
+	return syncFileSystem(fs);
+}
+
+int32_t syncPendingDirectories(struct sFileSystem *fs) {
+/*
+	syncs directories that were written but not synced yet
+*/
+	assert(fs != NULL);
+
+	if (unsyncedDirs == 0) return 0;
+
+	unsyncedDirs=0;
+	unsyncedBytes=0;
+
+	return syncFileSystem(fs);
+}
+
+void parseLongFilename(struct sFileSystem *fs, u_char *lfn, u_int32_t units, char *str) {
 /*
-	retrieves a part of a long filename from a
-	directory entry
-	(thanks to M$ for this ugly hack...)
+	decodes the UTF-16LE long filename assembled from the long dir entries
+	of a file. It ends at the first NUL code unit or after units code units.
 */
 
-	assert(lde != NULL);
+	assert(fs != NULL);
+	assert(lfn != NULL);
 	assert(str != NULL);
 
 	size_t incount;
 	size_t outcount;
 	char *outptr = &(str[0]);
-	char utf16str[28];
-	char *inptr=&(utf16str[0]);
-	size_t ret;
-
-	str[0]='\0';
-
-	memcpy(utf16str, (&lde->LDIR_Ord+1), 10);
-	memcpy(utf16str+10, (&lde->LDIR_Ord+14), 12);
-	memcpy(utf16str+22, (&lde->LDIR_Ord+28), 4);
-	memset(utf16str+26, 0, 2);
+	char *inptr = (char *) lfn;
+	u_int32_t i;
 
-	incount=26;
-	outcount=MAX_PATH_LEN;
+	if (fs->utf8Names) {
+		utf16leToUTF8(lfn, units, str, MAX_PATH_LEN+1);
+		return;
+	}
 
-	int i;
-	for (i=0;i<12; i++) {
-		if ((utf16str[i*2] == '\0') && (utf16str[i*2+1] == '\0')) {
-			incount=i*2;
-			break;
-		}
+	for (i=0; i<units; i++) {
+		if ((lfn[i*2] == '\0') && (lfn[i*2+1] == '\0')) break;
 	}
 
-	//printf("Incount: %u\n", incount);
+	incount=i*2;
+	outcount=MAX_PATH_LEN;
 
 	while (incount != 0) {
-                if ((ret=iconv(cd, &inptr, &incount, &outptr, &outcount)) == (size_t)-1) {
+		if (iconv(fs->cd, &inptr, &incount, &outptr, &outcount) == (size_t)-1) {
 			stderror();
-                        myerror("WARNING: iconv failed!");
+			myerror("WARNING: iconv failed!");
 			break;
-                }
-        }
+		}
+	}
 	outptr[0]='\0';
-
-	return 0;
 }
 
 void parseShortFilename(struct sShortDirEntry *sde, char *str) {
@@ -112,412 +153,341 @@ void parseShortFilename(struct sShortDirEntry *sde, char *str) {
 	}
 }
 
-int32_t checkLongDirEntries(struct sDirEntryList *list) {
+int32_t checkLongDirEntries(struct sDirEntryTable *table, struct sDirFile *file, u_char calculatedChecksum) {
 /*
-	does some integrity checks on LongDirEntries
+	does some integrity checks on LongDirEntries,
+	calculatedChecksum is the checksum of the short name of file
 */
-	assert(list != NULL);
+	assert(table != NULL);
+	assert(file != NULL);
 
-	u_char calculatedChecksum;
 	u_int32_t i;
 	u_int32_t nr;
-	struct sLongDirEntryList  *tmp;
+	struct sLongDirEntry *lde;
 
-	if (list->entries > 1) {
-		calculatedChecksum = calculateChecksum(list->sde->DIR_Name);
-		if ((list->ldel->lde->LDIR_Ord != DE_FREE) && // ignore deleted entries
-			 !(list->ldel->lde->LDIR_Ord & LAST_LONG_ENTRY)) {
+	if (file->entries > 1) {
+		lde=&table->entries[file->first].LongDirEntry;
+		if ((lde->LDIR_Ord != DE_FREE) && // ignore deleted entries
+			 !(lde->LDIR_Ord & LAST_LONG_ENTRY)) {
 			myerror("LongDirEntry should be marked as last long dir entry but isn't!");
 			return -1;
 		}
 
-		tmp = list->ldel;
-
-		for(i=0;i < list->entries - 1; i++) {
-			if (tmp->lde->LDIR_Ord != DE_FREE) { // ignore deleted entries
-				nr=tmp->lde->LDIR_Ord & ~LAST_LONG_ENTRY;	// index of long dir entry
-				//fprintf(stderr, "Debug: count=%x, LDIR_Ord=%x\n", list->entries - 1 -i, tmp->lde->LDIR_Ord);
-				if (nr != (list->entries - 1 - i)) {
+		for(i=0;i < file->entries - 1; i++) {
+			lde=&table->entries[file->first + i].LongDirEntry;
+			if (lde->LDIR_Ord != DE_FREE) { // ignore deleted entries
+				nr=lde->LDIR_Ord & ~LAST_LONG_ENTRY;	// index of long dir entry
+				//fprintf(stderr, "Debug: count=%x, LDIR_Ord=%x\n", file->entries - 1 -i, lde->LDIR_Ord);
+				if (nr != (file->entries - 1 - i)) {
 					myerror("LongDirEntry number is 0x%x (0x%x) but should be 0x%x!",
-						nr, tmp->lde->LDIR_Ord, list->entries - 1 - i );
+						nr, lde->LDIR_Ord, file->entries - 1 - i );
 					return -1;
-				} else if (tmp->lde->LDIR_Checksum != calculatedChecksum) {
+				} else if (lde->LDIR_Checksum != calculatedChecksum) {
 					myerror("Checksum for LongDirEntry is 0x%x but should be 0x%x!",
-						tmp->lde->LDIR_Checksum,
+						lde->LDIR_Checksum,
 						calculatedChecksum);
 					return -1;
 				}
 			}
-			tmp = tmp->next;
 		}
 	}
 
 	return 0;
 }
 
-int32_t parseClusterChain(struct sFileSystem *fs, struct sClusterChain *chain, struct sDirEntryList *list, u_int32_t *direntries) {
+int32_t parseDirEntries(struct sFileSystem *fs, struct sDirEntryTable *table, u_int32_t count, u_int32_t *pos) {
 /*
-	parses a cluster chain and puts found directory entries to list
+	parses the first count dir entries of table and adds the found files to table,
+	pos receives the index of the last parsed entry
 */
 
 	assert(fs != NULL);
-	assert(chain != NULL);
-	assert(list != NULL);
-	assert(direntries != NULL);
+	assert(table != NULL);
+	assert(count <= table->maxEntries);
+	assert(pos != NULL);
 
-	u_int32_t j;
-	int32_t ret;
+	union sDirEntry *de=table->entries;
+	u_int32_t j, k;
 	u_int32_t entries=0;
-	union sDirEntry de;
-	struct sDirEntryList *lnde;
-	struct sLongDirEntryList *llist;
-	char tmp[MAX_PATH_LEN+1], dummy[MAX_PATH_LEN+1], sname[MAX_PATH_LEN+1], lname[MAX_PATH_LEN+1];
-
-	*direntries=0;
-
-	chain=chain->next;	// head element
-
-	llist = NULL;
-	lname[0]='\0';
-	while (chain != NULL) {
-		fs_seek(fs->fd, getClusterOffset(fs, chain->cluster), SEEK_SET);
-		for (j=0;j<fs->maxDirEntriesPerCluster;j++) {
-			entries++;
-			ret=parseEntry(fs, &de);
-
-			switch(ret) {
-			case -1:
-				myerror("Failed to parse directory entry!");
-				return -1;
-			case 0: // current dir entry and following dir entries are free
-				if (llist != NULL) {
-					// short dir entry is still missing!
-					myerror("ShortDirEntry is missing after LongDirEntries (cluster: %08lx, entry %u)!",
-						chain->cluster, j);
-					return -1;
-				} else {
-					return 0;
-				}
-			case 1: // short dir entry
-				parseShortFilename(&de.ShortDirEntry, sname);
-
-				if (OPT_LIST &&
-				   strcmp(sname, ".") &&
-				   strcmp(sname, "..") &&
-				   (((u_char) sname[0]) != DE_FREE) &&
-				  !(de.ShortDirEntry.DIR_Atrr & ATTR_VOLUME_ID)) {
-
-					if (!OPT_MORE_INFO) {
-						printf("%s\n", (lname[0] != '\0') ? lname : sname);
-					} else {
-						printf("%s (%s)\n", (lname[0] != '\0') ? lname : "n/a", sname);
-					}
-				}
-
-				lnde=newDirEntry(sname, lname, &de.ShortDirEntry, llist, entries);
-				if (lnde == NULL) {
-					myerror("Failed to create DirEntry!");
-					return -1;
-				}
+	u_int64_t bit;
+	struct sDirEntryClass cls;
+	char sname[MAX_PATH_LEN+1], lname[MAX_PATH_LEN+1];
+	// long name parts are collected from the back as the last part comes first
+	u_char lfn[MAX_LONG_DIR_ENTRIES*LDIR_NAME_BYTES];
+	u_int32_t lfnStart=sizeof(lfn);
+
+	for (j=0;j<count;j++) {
+		*pos=j;
+		entries++;
 
-				if (checkLongDirEntries(lnde)) {
-					myerror("checkDirEntry failed in cluster %08lx at entry %u!", chain->cluster, j);
-					return -1;
-				}
+		// classify the next block of dir entries at once
+		k=j % DIR_CLASS_BLOCK;
+		if (k == 0) classifyDirEntries(&de[j], MIN(count - j, DIR_CLASS_BLOCK), &cls);
+		bit=(u_int64_t) 1 << k;
 
-				insertDirEntryList(lnde, list);
-				(*direntries)++;
-				entries=0;
-				llist = NULL;
+		if (cls.end & bit) { // current dir entry and following dir entries are free
+			if (entries > 1) {
+				// short dir entry is still missing!
+				myerror("ShortDirEntry is missing after LongDirEntries!");
+				return -1;
+			} else {
+				return 0;
+			}
+		} else if (cls.shortName & bit) {
+			parseShortFilename(&de[j].ShortDirEntry, sname);
+			if (lfnStart < sizeof(lfn)) {
+				parseLongFilename(fs, lfn + lfnStart, (sizeof(lfn) - lfnStart) / 2, lname);
+			} else {
 				lname[0]='\0';
-				break;
-			case 2: // long dir entry
-				if (parseLongFilenamePart(&de.LongDirEntry, tmp, fs->cd)) {
-					myerror("Failed to parse long filename part!");
-					return -1;
-				}
+			}
 
-				// insert long dir entry in list
-				llist=insertLongDirEntryList(&de.LongDirEntry, llist);
-				if (llist == NULL) {
-					myerror("Failed to insert LongDirEntry!");
-					return -1;
+			if (OPT_LIST &&
+			   strcmp(sname, ".") &&
+			   strcmp(sname, "..") &&
+			  !((cls.deleted | cls.volumeLabel) & bit)) {
+
+				if (!OPT_MORE_INFO) {
+					printf("%s\n", (lname[0] != '\0') ? lname : sname);
+				} else {
+					printf("%s (%s)\n", (lname[0] != '\0') ? lname : "n/a", sname);
 				}
+			}
 
-				strncpy(dummy, tmp, MAX_PATH_LEN);
-				dummy[MAX_PATH_LEN]='\0';
-				strncat(dummy, lname, MAX_PATH_LEN - strlen(dummy));
-				dummy[MAX_PATH_LEN]='\0';
-				strncpy(lname, dummy, MAX_PATH_LEN);
-				dummy[MAX_PATH_LEN]='\0';
-				break;
-			default:
-				myerror("Unhandled return code!");
+			// the long dir entries of the file directly precede its short dir entry
+			if (addDirFile(table, sname, lname, j + 1 - entries, entries) == -1) {
+				myerror("Failed to add file to directory table!");
 				return -1;
 			}
 
+			if (checkLongDirEntries(table, &table->files[table->fileCount - 1], cls.checksum[k])) {
+				myerror("checkDirEntry failed!");
+				return -1;
+			}
+
+			entries=0;
+			lfnStart=sizeof(lfn);
+		} else { // long dir entry
+			// surplus parts are dropped, checkLongDirEntries rejects the file anyway
+			if (lfnStart >= LDIR_NAME_BYTES) {
+				lfnStart-=LDIR_NAME_BYTES;
+				memcpy(lfn + lfnStart, de[j].LongDirEntry.LDIR_Name1, 10);
+				memcpy(lfn + lfnStart + 10, de[j].LongDirEntry.LDIR_Name2, 12);
+				memcpy(lfn + lfnStart + 22, de[j].LongDirEntry.LDIR_Name3, 4);
+			}
 		}
-		chain=chain->next;
+
 	}
 
-	if (llist != NULL) {
+	if (entries > 0) {
 		// short dir entry is still missing!
-		myerror("ShortDirEntry is missing after LongDirEntries (root directory entry %d)!", j);
+		myerror("ShortDirEntry is missing after LongDirEntries!");
 		return -1;
 	}
 
 	return 0;
 }
 
-int32_t parseFAT1xRootDirEntries(struct sFileSystem *fs, struct sDirEntryList *list, u_int32_t *direntries) {
+int32_t parseClusterChain(struct sFileSystem *fs, struct sClusterChain *chain, struct sDirEntryTable *table) {
 /*
-	parses FAT1x root directory entries to list
+	reads a cluster chain into the entries of table and adds the found files to table,
+	the table must hold all clusters of the chain
 */
 
 	assert(fs != NULL);
-	assert(list != NULL);
-	assert(direntries != NULL);
+	assert(chain != NULL);
+	assert(table != NULL);
+	assert(table->maxEntries >= chain->clusterCount * fs->maxDirEntriesPerCluster);
+
+	union sDirEntry *buffer=table->entries;
+	u_int32_t r, w, n, j, window, count=0, next, pos=0;
+	u_int32_t last=0;
+	struct sIORequest *reqs;
+
+	// read the directory window by window until the end of directory mark shows up,
+	// a window holds as many runs as the backend transfers at once
+	window=MIN(fs_batchSize(&(fs->io)), MAX(chain->runCount, 1));
+	if ((reqs=malloc(window * sizeof(struct sIORequest))) == NULL) {
+		stderror();
+		return -1;
+	}
+	for (r=0; (r<chain->runCount) && !last; r+=n) {
+		n=MIN(window, chain->runCount - r);
+		for (w=0, next=count; w < n; w++) {
+			reqs[w].buf=&buffer[next];
+			reqs[w].size=(size_t) chain->runs[r+w].length * fs->clusterSize;
+			reqs[w].offset=getClusterOffset(fs, chain->runs[r+w].start);
+			next+=chain->runs[r+w].length * fs->maxDirEntriesPerCluster;
+		}
+		if (fs_readBatch(&(fs->io), reqs, n) == -1) {
+			myerror("Failed to read cluster runs (cluster %08lx, %u runs)!", chain->runs[r].start, n);
+			free(reqs);
+			return -1;
+		}
 
-	off_t BSOffset;
-	int32_t j, ret;
-	u_int32_t entries=0;
-	union sDirEntry de;
-	struct sDirEntryList *lnde;
-	struct sLongDirEntryList *llist;
-	char tmp[MAX_PATH_LEN+1], dummy[MAX_PATH_LEN+1], sname[MAX_PATH_LEN+1], lname[MAX_PATH_LEN+1];
+		// the directory ends with the run that holds the end of directory mark
+		for (w=0; (w < n) && !last; w++) {
+			for (j=count; j < count + chain->runs[r+w].length * fs->maxDirEntriesPerCluster; j++) {
+				if (buffer[j].ShortDirEntry.DIR_Name[0] == DE_FOLLOWING_FREE) {
+					last=1;
+					break;
+				}
+			}
+			count+=chain->runs[r+w].length * fs->maxDirEntriesPerCluster;
+		}
+	}
+	free(reqs);
 
-	*direntries=0;
+	if (parseDirEntries(fs, table, count, &pos) == -1) {
+		myerror("Failed to parse directory entries (cluster: %08lx, entry %u)!",
+			getClusterAt(chain, pos / fs->maxDirEntriesPerCluster), pos % fs->maxDirEntriesPerCluster);
+		return -1;
+	}
 
-	llist = NULL;
-	lname[0]='\0';
+	return 0;
+}
+
+int32_t parseFAT1xRootDirEntries(struct sFileSystem *fs, struct sDirEntryTable *table) {
+/*
+	reads FAT1x root directory into the entries of table and adds the found files to table,
+	the table must hold BS_RootEntCnt entries
+*/
+
+	assert(fs != NULL);
+	assert(table != NULL);
+	assert(table->maxEntries >= SwapInt16(fs->bs.BS_RootEntCnt));
+
+	off_t BSOffset;
+	u_int32_t pos=0;
 
 	BSOffset = ((off_t)SwapInt16(fs->bs.BS_RsvdSecCnt) +
 		fs->bs.BS_NumFATs * fs->FATSize) * fs->sectorSize;
 
-	fs_seek(fs->fd, BSOffset, SEEK_SET);
+	if (fs_readAt(&(fs->io), table->entries, (size_t) DIR_ENTRY_SIZE * SwapInt16(fs->bs.BS_RootEntCnt), BSOffset) !=
+			(ssize_t) DIR_ENTRY_SIZE * SwapInt16(fs->bs.BS_RootEntCnt)) {
+		myerror("Failed to read from file!");
+		return -1;
+	}
 
-	for (j=0;j<SwapInt16(fs->bs.BS_RootEntCnt);j++) {
-		entries++;
-		ret=parseEntry(fs, &de);
+	if (parseDirEntries(fs, table, SwapInt16(fs->bs.BS_RootEntCnt), &pos) == -1) {
+		myerror("Failed to parse directory entries (root directory entry %u)!", pos);
+		return -1;
+	}
 
-		switch(ret) {
-		case -1:
-			myerror("Failed to parse directory entry!");
-			return -1;
-		case 0: // current dir entry and following dir entries are free
-			if (llist != NULL) {
-				// short dir entry is still missing!
-				myerror("ShortDirEntry is missing after LongDirEntries (root directory entry %u)!", j);
-				return -1;
-			} else {
-				return 0;
-			}
-		case 1: // short dir entry
-			parseShortFilename(&de.ShortDirEntry, sname);
+	return 0;
+}
 
-			if (OPT_LIST &&
-			   strcmp(sname, ".") &&
-			   strcmp(sname, "..") &&
-			   (((u_char) sname[0]) != DE_FREE) &&
-			  !(de.ShortDirEntry.DIR_Atrr & ATTR_VOLUME_ID)) {
+u_int32_t assembleDirEntries(struct sDirEntryTable *table, union sDirEntry *image) {
+/*
+	serializes the dir entries of all files of table in sorted order to image,
+	returns the number of entries
+*/
 
-				if (!OPT_MORE_INFO) {
-					printf("%s\n", (lname[0] != '\0') ? lname : sname);
-				} else {
-					printf("%s (%s)\n", (lname[0] != '\0') ? lname : "n/a", sname);
-				}
-			}
+	assert(table != NULL);
+	assert(image != NULL);
 
-			lnde=newDirEntry(sname, lname, &de.ShortDirEntry, llist, entries);
-			if (lnde == NULL) {
-				myerror("Failed to create DirEntry!");
-				return -1;
-			}
+	u_int32_t i, n=0;
+	struct sDirFile *file;
 
-			if (checkLongDirEntries(lnde)) {
-				myerror("checkDirEntry failed at root directory entry %u!", j);
-				return -1;
-			}
+	for (i=0; i < table->fileCount; i++) {
+		file=&table->files[table->order[i].index];
+		memcpy(&image[n], &table->entries[file->first], file->entries * DIR_ENTRY_SIZE);
+		n+=file->entries;
+	}
 
-			insertDirEntryList(lnde, list);
-			(*direntries)++;
-			entries=0;
-			llist = NULL;
-			lname[0]='\0';
-			break;
-		case 2: // long dir entry
-			if (parseLongFilenamePart(&de.LongDirEntry, tmp, fs->cd)) {
-				myerror("Failed to parse long filename part!");
-				return -1;
-			}
+	return n;
+}
 
-			// insert long dir entry in list
-			llist=insertLongDirEntryList(&de.LongDirEntry, llist);
-			if (llist == NULL) {
-				myerror("Failed to insert LongDirEntry!");
-				return -1;
-			}
+int32_t isInDiskOrder(struct sDirEntryTable *table) {
+/*
+	checks whether the files of table are sorted in the same order
+	as they are stored in the directory
+*/
 
-			strncpy(dummy, tmp, MAX_PATH_LEN);
-			dummy[MAX_PATH_LEN]='\0';
-			strncat(dummy, lname, MAX_PATH_LEN - strlen(dummy));
-			dummy[MAX_PATH_LEN]='\0';
-			strncpy(lname, dummy, MAX_PATH_LEN);
-			dummy[MAX_PATH_LEN]='\0';
-			break;
-		default:
-			myerror("Unhandled return code!");
-			return -1;
-		}
+	assert(table != NULL);
 
-	}
+	u_int32_t i;
 
-	if (llist != NULL) {
-		// short dir entry is still missing!
-		myerror("ShortDirEntry is missing after LongDirEntries (root dir entry %d)!", j);
-		return -1;
+	for (i=0; i < table->fileCount; i++) {
+		if (table->order[i].index != i) return 0;
 	}
 
-	return 0;
+	return 1;
 }
 
-int32_t writeList(struct sFileSystem *fs, struct sDirEntryList *list) {
+int32_t writeList(struct sFileSystem *fs, struct sDirEntryTable *table) {
 /*
-	writes directory entries to file
+	writes the sorted dir entries of table to the FAT1x root directory,
+	the entries of table hold the root directory as it was read
 */
 
 	assert(fs != NULL);
-	assert(list != NULL);
+	assert(table != NULL);
+
+	off_t BSOffset;
+	u_int32_t n, size;
+	union sDirEntry *image;
+
+	n=table->entryCount;
+
+	// write whole sectors, the rest of the last sector is kept
+	size=MIN((n * DIR_ENTRY_SIZE + fs->sectorSize - 1) / fs->sectorSize * fs->sectorSize,
+		(u_int32_t) SwapInt16(fs->bs.BS_RootEntCnt) * DIR_ENTRY_SIZE);
 
-	struct sLongDirEntryList *tmp;
+	if ((image=malloc(size)) == NULL) {
+		stderror();
+		return -1;
+	}
+	memcpy(image, table->entries, size);
+	assembleDirEntries(table, image);
+
+	BSOffset = ((off_t)SwapInt16(fs->bs.BS_RsvdSecCnt) +
+		fs->bs.BS_NumFATs * fs->FATSize) * fs->sectorSize;
 
 	// no signal handling while writing (atomic action)
 	start_critical_section();
 
-	while(list->next!=NULL) {
-		tmp=list->next->ldel;
-		while(tmp != NULL) {
-			if (fs_write(tmp->lde, DIR_ENTRY_SIZE, 1, fs->fd)<1) {
-				// end of critical section
-				end_critical_section();
-
-				stderror();
-				return -1;
-			}
-			tmp=tmp->next;
-		}
-		if (fs_write(list->next->sde, DIR_ENTRY_SIZE, 1, fs->fd)<1) {
-			// end of critical section
-			end_critical_section();
+	if ((size != 0) && (fs_writeAt(&(fs->io), image, size, BSOffset) != size)) {
+		// end of critical section
+		end_critical_section();
 
-			stderror();
-			return -1;
-		}
-		list=list->next;
+		stderror();
+		free(image);
+		return -1;
 	}
 
 	// sync fs
-	syncFileSystem(fs);
+	if (commitDirectory(fs, size)) {
+		// end of critical section
+		end_critical_section();
+
+		myerror("Failed to commit root directory!");
+		free(image);
+		return -1;
+	}
 
 	// end of critical section
 	end_critical_section();
 
+	free(image);
+
 	return 0;
 }
 
 int32_t getClusterChain(struct sFileSystem *fs, u_int32_t startCluster, struct sClusterChain *chain) {
 /*
-	retrieves an array of all clusters in a cluster chain
+	retrieves all clusters in a cluster chain
 	starting with startCluster
 */
 
 	assert(fs != NULL);
 	assert(chain != NULL);
 
-	int32_t cluster;
-	u_int32_t data,i=0;
-
-	cluster=startCluster;
+	u_int32_t cluster, data, i=0;
 
 	switch(fs->FATType) {
 	case FATTYPE_FAT12:
-		do {
-			if (i == fs->maxClusterChainLength) {
-				myerror("Cluster chain is too long!");
-				return -1;
-			}
-			if (cluster >= fs->clusters+2) {
-				myerror("Cluster %08x does not exist!", data);
-				return -1;
-			}
-			if (insertCluster(chain, cluster) == -1) {
-				myerror("Failed to insert cluster!");
-				return -1;
-			}
-			i++;
-			if (getFATEntry(fs, cluster, &data)) {
-				myerror("Failed to get FAT entry!");
-				return -1;
-			}
-			if (data == 0) {
-				myerror("Cluster %08x is marked as unused!", cluster);
-				return -1;
-			}
-			cluster=data;
-		} while (cluster < 0x0ff8);	// end of cluster
-		break;
 	case FATTYPE_FAT16:
-		do {
-			if (i == fs->maxClusterChainLength) {
-				myerror("Cluster chain is too long!");
-				return -1;
-			}
-			if (cluster >= fs->clusters+2) {
-				myerror("Cluster %08x does not exist!", data);
-				return -1;
-			}
-			if (insertCluster(chain, cluster) == -1) {
-				myerror("Failed to insert cluster!");
-				return -1;
-			}
-			i++;
-			if (getFATEntry(fs, cluster, &data)) {
-				myerror("Failed to get FAT entry!");
-				return -1;
-			}
-			if (data == 0) {
-				myerror("Cluster %08x is marked as unused!", cluster);
-				return -1;
-			}
-			cluster=data;
-		} while (cluster < 0xfff8);	// end of cluster
-		break;
 	case FATTYPE_FAT32:
-		do {
-			if (i == fs->maxClusterChainLength) {
-				myerror("Cluster chain is too long!");
-				return -1;
-			}
-			if ((cluster & 0x0fffffff) >= fs->clusters+2) {
-				myerror("Cluster %08x does not exist!", data);
-				return -1;
-			}
-			if (insertCluster(chain, cluster) == -1) {
-				myerror("Failed to insert cluster!");
-				return -1;
-			}
-			i++;
-			if (getFATEntry(fs, cluster, &data)) {
-				myerror("Failed to get FAT entry");
-				return -1;
-			}
-			if ((data & 0x0fffffff) == 0) {
-				myerror("Cluster %08x is marked as unused!", cluster);
-				return -1;
-			}
-			cluster=data;
-		} while (((cluster & 0x0fffffff) != 0x0ff8fff8) &&
-			 ((cluster & 0x0fffffff) < 0x0ffffff8));	// end of cluster
 		break;
 	case -1:
 	default:
@@ -525,136 +495,135 @@ int32_t getClusterChain(struct sFileSystem *fs, u_int32_t startCluster, struct s
 		return -1;
 	}
 
+	cluster=startCluster;
+
+	do {
+		if (i == fs->maxClusterChainLength) {
+			myerror("Cluster chain is too long!");
+			return -1;
+		}
+		if (cluster >= (u_int32_t) fs->clusters+2) {
+			myerror("Cluster %08x does not exist!", cluster);
+			return -1;
+		}
+		if (insertCluster(chain, cluster) == -1) {
+			myerror("Failed to insert cluster!");
+			return -1;
+		}
+		i++;
+		// FAT is held in memory
+		data=fs->FAT[cluster];
+		if (data == 0) {
+			myerror("Cluster %08x is marked as unused!", cluster);
+			return -1;
+		}
+		cluster=data;
+	} while (!isEOC(fs, cluster) &&
+		 !((fs->FATType == FATTYPE_FAT32) && (cluster == 0x0ff8fff8)));	// end of cluster
+
 	return i;
 }
 
-int32_t writeClusterChain(struct sFileSystem *fs, struct sDirEntryList *list, struct sClusterChain *chain) {
+int32_t writeClusterChain(struct sFileSystem *fs, struct sDirEntryTable *table, struct sClusterChain *chain) {
 /*
-	writes all entries from list to the cluster chain
+	writes the sorted dir entries of table to the cluster chain,
+	the entries of table hold the directory as it was read from the cluster chain
 */
 
 	assert(fs != NULL);
-	assert(list != NULL);
+	assert(table != NULL);
 	assert(chain != NULL);
 
-	u_int32_t i=0, entries=0;
-	struct sLongDirEntryList *tmp;
-	struct sDirEntryList *p=list->next;
-	char empty[DIR_ENTRY_SIZE]={0};
+	u_int32_t n, clusters, count, r, written=0;
+	union sDirEntry *image;
+	struct sIORequest *reqs;
 
-	chain=chain->next;	// we don't need to look at the head element
+	n=table->entryCount;
 
-	if (fs_seek(fs->fd, getClusterOffset(fs, chain->cluster), SEEK_SET)==-1) {
-		myerror("Seek error!");
+	// clusters that are occupied by entries and the end of directory mark
+	clusters=(n == 0) ? 1 : (n + fs->maxDirEntriesPerCluster - 1) / fs->maxDirEntriesPerCluster;
+
+	// assemble the sorted directory in whole clusters, the rest of the last cluster is kept
+	if ((image=malloc((size_t) clusters * fs->clusterSize)) == NULL) {
+		stderror();
 		return -1;
 	}
+	memcpy(image, table->entries, (size_t) clusters * fs->clusterSize);
+	assembleDirEntries(table, image);
+	if (n < clusters * fs->maxDirEntriesPerCluster) {
+		memset(&image[n], 0, DIR_ENTRY_SIZE);
+	}
+
+	// one write per run of consecutive clusters, all in one batch
+	if ((reqs=malloc(chain->runCount * sizeof(struct sIORequest))) == NULL) {
+		stderror();
+		free(image);
+		return -1;
+	}
+	for (r=0; written < clusters; r++) {
+		count=MIN(chain->runs[r].length, clusters - written);
+		reqs[r].buf=(u_char *) image + (size_t) written * fs->clusterSize;
+		reqs[r].size=(size_t) count * fs->clusterSize;
+		reqs[r].offset=getClusterOffset(fs, chain->runs[r].start);
+		written+=count;
+	}
 
 	// no signal handling while writing (atomic action)
 	start_critical_section();
 
-	while(p != NULL) {
-		if (entries+p->entries <= fs->maxDirEntriesPerCluster) {
-			tmp=p->ldel;
-			for (i=1;i<p->entries;i++) {
-				if (fs_write(tmp->lde, DIR_ENTRY_SIZE, 1, fs->fd)<1) {
-					// end of critical section
-					end_critical_section();
-
-					stderror();
-					return -1;
-				}
-				tmp=tmp->next;
-			}
-			if (fs_write(p->sde, DIR_ENTRY_SIZE, 1, fs->fd)<1) {
-				// end of critical section
-				end_critical_section();
-
-				stderror();
-				return -1;
-			}
-			entries+=p->entries;
-		} else {
-			tmp=p->ldel;
-			for (i=1;i<=fs->maxDirEntriesPerCluster-entries;i++) {
-				if (fs_write(tmp->lde, DIR_ENTRY_SIZE, 1, fs->fd)<1) {
-					// end of critical section
-					end_critical_section();
-
-					stderror();
-					return -1;
-				}
-				tmp=tmp->next;
-			}
-			chain=chain->next; entries=p->entries - (fs->maxDirEntriesPerCluster - entries);	// next cluster
-			if (fs_seek(fs->fd, getClusterOffset(fs, chain->cluster), SEEK_SET)==-1) {
-
-				// end of critical section
-				end_critical_section();
-
-				myerror("Seek error!");
-				return -1;
-			}
-			while(tmp!=NULL) {
-				if (fs_write(tmp->lde, DIR_ENTRY_SIZE, 1, fs->fd)<1) {
-					// end of critical section
-					end_critical_section();
+	if (fs_writeBatch(&(fs->io), reqs, r) == -1) {
+		// end of critical section
+		end_critical_section();
 
-					stderror();
-					return -1;
-				}
-				tmp=tmp->next;
-			}
-			if (fs_write(p->sde, DIR_ENTRY_SIZE, 1, fs->fd)<1) {
-				// end of critical section
-				end_critical_section();
-
-				stderror();
-				return -1;
-			}
-		}
-		p=p->next;
-	}
-	if (entries < fs->maxDirEntriesPerCluster) {
-		if (fs_write(empty, DIR_ENTRY_SIZE, 1, fs->fd)<1) {
-			// end of critical section
-			end_critical_section();
-
-			stderror();
-			return -1;
-		}
+		myerror("Failed to write cluster chain (cluster %08lx, %u runs)!", chain->runs[0].start, r);
+		free(reqs);
+		free(image);
+		return -1;
 	}
+	free(reqs);
 
 	// sync fs
-	syncFileSystem(fs);
+	if (commitDirectory(fs, clusters * fs->clusterSize)) {
+		// end of critical section
+		end_critical_section();
+
+		myerror("Failed to commit directory (cluster %08lx)!", chain->runs[0].start);
+		free(image);
+		return -1;
+	}
 
 	// end of critical section
 	end_critical_section();
 
+	free(image);
+
 	return 0;
 
 }
 
-int32_t sortSubdirectories(struct sFileSystem *fs, struct sDirEntryList *list, const char (*path)[MAX_PATH_LEN+1]) {
+int32_t sortSubdirectories(struct sFileSystem *fs, struct sDirEntryTable *table, const char (*path)[MAX_PATH_LEN+1]) {
 /*
 	sorts sub directories in a FAT file system
 */
 	assert(fs != NULL);
-	assert(list != NULL);
+	assert(table != NULL);
 	assert(path != NULL);
 
-	struct sDirEntryList *p;
+	struct sDirFile *p;
+	struct sShortDirEntry *sde;
 	char newpath[MAX_PATH_LEN+1]={0};
-	u_int32_t c, value;
-
-	// sort sub directories
-	p=list->next;
-	while (p != NULL) {
-		if ((p->sde->DIR_Atrr & ATTR_DIRECTORY) &&
-			((u_char) p->sde->DIR_Name[0] != DE_FREE) &&
-			!(p->sde->DIR_Atrr & ATTR_VOLUME_ID) &&
+	u_int32_t i, c, value;
+
+	// sort sub directories in sorted order
+	for (i=0; i < table->fileCount; i++) {
+		p=&table->files[table->order[i].index];
+		sde=FILE_SDE(table, p);
+		if ((sde->DIR_Atrr & ATTR_DIRECTORY) &&
+			((u_char) sde->DIR_Name[0] != DE_FREE) &&
+			!(sde->DIR_Atrr & ATTR_VOLUME_ID) &&
 			(strcmp(p->sname, ".")) && strcmp(p->sname, "..")) {
 
-			c=(SwapInt16(p->sde->DIR_FstClusHI) * 65536 + SwapInt16(p->sde->DIR_FstClusLO));
+			c=(SwapInt16(sde->DIR_FstClusHI) * 65536 + SwapInt16(sde->DIR_FstClusLO));
 			if (getFATEntry(fs, c, &value) == -1) {
 				myerror("Failed to get FAT entry!");
 				return -1;
@@ -680,7 +649,6 @@ int32_t sortSubdirectories(struct sFileSystem *fs, struct sDirEntryList *list, c
 			}
 
 		}
-		p=p->next;
 	}
 
 	return 0;
@@ -694,10 +662,11 @@ int32_t sortClusterChain(struct sFileSystem *fs, u_int32_t cluster, const char (
 	assert(fs != NULL);
 	assert(path != NULL);
 
-	u_int32_t direntries;
 	int32_t clen;
 	struct sClusterChain *ClusterChain;
-	struct sDirEntryList *list;
+	struct sDirEntryTable *table;
+	struct sArena *arena;
+	union sDirEntry *buffer;
 
 	u_int32_t match;
 
@@ -708,20 +677,21 @@ int32_t sortClusterChain(struct sFileSystem *fs, u_int32_t cluster, const char (
 		if (OPT_REGEX_INCL->next != NULL) match &= matchesRegExList(OPT_REGEX_INCL, (const char *) path);
 	}
 
-	if ((ClusterChain=newClusterChain()) == NULL) {
+	if ((ClusterChain=newClusterChain(fs->clusterBitmap)) == NULL) {
 		myerror("Failed to generate new ClusterChain!");
 		return -1;
 	}
 
-	if ((list = newDirEntryList()) == NULL) {
-		myerror("Failed to generate new dirEntryList!");
+	// all entries of this directory are allocated from this arena
+	if ((arena = newArena()) == NULL) {
+		myerror("Failed to generate new arena!");
 		freeClusterChain(ClusterChain);
 		return -1;
 	}
 
 	if ((clen=getClusterChain(fs, cluster, ClusterChain)) == -1 ) {
 		myerror("Failed to get cluster chain!");
-		freeDirEntryList(list);
+		freeArena(arena);
 		freeClusterChain(ClusterChain);
 		return -1;
 	}
@@ -740,10 +710,35 @@ int32_t sortClusterChain(struct sFileSystem *fs, u_int32_t cluster, const char (
 				cluster, clen, clen*fs->clusterSize);
 	}
 
-	if (parseClusterChain(fs, ClusterChain, list, &direntries) == -1) {
+	// directory entries are kept in this buffer while the directory is processed
+	if ((buffer=malloc((size_t) clen * fs->clusterSize)) == NULL) {
+		stderror();
+		freeArena(arena);
+		freeClusterChain(ClusterChain);
+		return -1;
+	}
+
+	if ((table = newDirEntryTable(arena, buffer, clen * fs->maxDirEntriesPerCluster)) == NULL) {
+		myerror("Failed to generate new dirEntryTable!");
+		freeArena(arena);
+		freeClusterChain(ClusterChain);
+		free(buffer);
+		return -1;
+	}
+
+	if (parseClusterChain(fs, ClusterChain, table) == -1) {
 		myerror("Failed to parse cluster chain!");
-		freeDirEntryList(list);
+		freeArena(arena);
+		freeClusterChain(ClusterChain);
+		free(buffer);
+		return -1;
+	}
+
+	if (sortDirEntryTable(table) == -1) {
+		myerror("Failed to sort directory entries!");
+		freeArena(arena);
 		freeClusterChain(ClusterChain);
+		free(buffer);
 		return -1;
 	}
 
@@ -751,13 +746,20 @@ int32_t sortClusterChain(struct sFileSystem *fs, u_int32_t cluster, const char (
 		// sort directory if selected
 		if (match) {
 
-			if (OPT_RANDOM) randomizeDirEntryList(list, direntries);
+			if (OPT_RANDOM) randomizeDirEntryTable(table);
 
-			if (writeClusterChain(fs, list, ClusterChain) == -1) {
+			// directory is written only if the order has changed
+			if (isInDiskOrder(table)) {
+				if (OPT_MORE_INFO) infomsg("Directory is already sorted.\n");
+				unchangedDirs++;
+			} else if (writeClusterChain(fs, table, ClusterChain) == -1) {
 				myerror("Failed to write cluster chain!");
-				freeDirEntryList(list);
+				freeArena(arena);
 				freeClusterChain(ClusterChain);
+				free(buffer);
 				return -1;
+			} else {
+				writtenDirs++;
 			}
 		}
 	} else {
@@ -767,12 +769,15 @@ int32_t sortClusterChain(struct sFileSystem *fs, u_int32_t cluster, const char (
 	freeClusterChain(ClusterChain);
 
 	// sort subdirectories
-	if (sortSubdirectories(fs, list, path) == -1 ){
+	if (sortSubdirectories(fs, table, path) == -1 ){
 		myerror("Failed to sort subdirectories!");
+		freeArena(arena);
+		free(buffer);
 		return -1;
 	}
 
-	freeDirEntryList(list);
+	freeArena(arena);
+	free(buffer);
 
 	return 0;
 }
@@ -784,11 +789,9 @@ int32_t sortFAT1xRootDirectory(struct sFileSystem *fs) {
 
 	assert(fs != NULL);
 
-	off_t BSOffset;
-
-	u_int32_t direntries=0;
-
-	struct sDirEntryList *list;
+	struct sDirEntryTable *table;
+	struct sArena *arena;
+	union sDirEntry *buffer;
 
 	u_int32_t match;
 
@@ -811,13 +814,37 @@ int32_t sortFAT1xRootDirectory(struct sFileSystem *fs) {
 		printf("/\n");
 	}
 
-	if ((list = newDirEntryList()) == NULL) {
-		myerror("Failed to generate new dirEntryList!");
+	// all entries of the root directory are allocated from this arena
+	if ((arena = newArena()) == NULL) {
+		myerror("Failed to generate new arena!");
 		return -1;
 	}
 
-	if (parseFAT1xRootDirEntries(fs, list, &direntries) == -1) {
+	// root directory entries are kept in this buffer while the directory is processed
+	if ((buffer=malloc((size_t) SwapInt16(fs->bs.BS_RootEntCnt) * DIR_ENTRY_SIZE)) == NULL) {
+		stderror();
+		freeArena(arena);
+		return -1;
+	}
+
+	if ((table = newDirEntryTable(arena, buffer, SwapInt16(fs->bs.BS_RootEntCnt))) == NULL) {
+		myerror("Failed to generate new dirEntryTable!");
+		freeArena(arena);
+		free(buffer);
+		return -1;
+	}
+
+	if (parseFAT1xRootDirEntries(fs, table) == -1) {
 		myerror("Failed to parse root directory entries!");
+		freeArena(arena);
+		free(buffer);
+		return -1;
+	}
+
+	if (sortDirEntryTable(table) == -1) {
+		myerror("Failed to sort root directory entries!");
+		freeArena(arena);
+		free(buffer);
 		return -1;
 	}
 
@@ -826,17 +853,19 @@ int32_t sortFAT1xRootDirectory(struct sFileSystem *fs) {
 		// sort matching directories
 		if (match) {
 
-			if (OPT_RANDOM) randomizeDirEntryList(list, direntries);
+			if (OPT_RANDOM) randomizeDirEntryTable(table);
 
-			BSOffset = ((off_t)SwapInt16(fs->bs.BS_RsvdSecCnt) +
-				fs->bs.BS_NumFATs * fs->FATSize) * fs->sectorSize;
-			fs_seek(fs->fd, BSOffset, SEEK_SET);
-
-			// write the sorted entries back to the fs
-			if (writeList(fs, list) == -1) {
-				freeDirEntryList(list);
+			// write the sorted entries back to the fs if the order has changed
+			if (isInDiskOrder(table)) {
+				if (OPT_MORE_INFO) infomsg("Directory is already sorted.\n");
+				unchangedDirs++;
+			} else if (writeList(fs, table) == -1) {
+				freeArena(arena);
+				free(buffer);
 			  	myerror("Failed to write root directory entries!");
 				return -1;
+			} else {
+				writtenDirs++;
 			}
 		}
 
@@ -845,13 +874,15 @@ int32_t sortFAT1xRootDirectory(struct sFileSystem *fs) {
 	}
 
 	// sort subdirectories
-	if (sortSubdirectories(fs, list, (const char (*)[MAX_PATH_LEN+1]) "/") == -1 ){
+	if (sortSubdirectories(fs, table, (const char (*)[MAX_PATH_LEN+1]) "/") == -1 ){
 		myerror("Failed to sort subdirectories!");
-		freeDirEntryList(list);
+		freeArena(arena);
+		free(buffer);
 		return -1;
 	}
 
-	freeDirEntryList(list);
+	freeArena(arena);
+	free(buffer);
 
 	return 0;
 }
@@ -875,7 +906,7 @@ int32_t sortFileSystem(char *filename) {
 		mode = FS_MODE_RO;
 	}
 
-	if (openFileSystem(filename, mode, &fs)) {
+	if (openFileSystem(filename, mode, OPT_IO_BACKEND, &fs)) {
 		myerror("Failed to open file system!");
 		return -1;
 	}
@@ -886,6 +917,11 @@ int32_t sortFileSystem(char *filename) {
 		return -1;
 	}
 
+	writtenDirs=0;
+	unchangedDirs=0;
+	unsyncedDirs=0;
+	unsyncedBytes=0;
+
 	switch(fs.FATType) {
 	case FATTYPE_FAT12:
 		// FAT12
@@ -893,6 +929,7 @@ int32_t sortFileSystem(char *filename) {
 		infomsg("File system: FAT12.\n\n");
 		if (sortFAT1xRootDirectory(&fs) == -1) {
 			myerror("Failed to sort FAT12 root directory!");
+			syncPendingDirectories(&fs);
 			closeFileSystem(&fs);
 			return -1;
 		}
@@ -903,6 +940,7 @@ int32_t sortFileSystem(char *filename) {
 		infomsg("File system: FAT16.\n\n");
 		if (sortFAT1xRootDirectory(&fs) == -1) {
 			myerror("Failed to sort FAT16 root directory!");
+			syncPendingDirectories(&fs);
 			closeFileSystem(&fs);
 			return -1;
 		}
@@ -914,6 +952,7 @@ int32_t sortFileSystem(char *filename) {
 		infomsg("File system: FAT32.\n\n");
 		if (sortClusterChain(&fs, SwapInt32(fs.bs.FATxx.FAT32.BS_RootClus), (const char(*)[MAX_PATH_LEN+1]) "/") == -1) {
 			myerror("Failed to sort first cluster chain!");
+			syncPendingDirectories(&fs);
 			closeFileSystem(&fs);
 			return -1;
 		}
@@ -924,6 +963,16 @@ int32_t sortFileSystem(char *filename) {
 		return -1;
 	}
 
+	if (syncPendingDirectories(&fs) == -1) {
+		myerror("Failed to sync file system!");
+		closeFileSystem(&fs);
+		return -1;
+	}
+
+	if (!OPT_LIST) {
+		infomsg("%u directories written, %u directories already sorted.\n", writtenDirs, unchangedDirs);
+	}
+
 	closeFileSystem(&fs);
 
 	return 0;
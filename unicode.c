@@ -0,0 +1,105 @@
+/*
+	FATSort, utility for sorting FAT directory structures
+	Copyright (C) 2004 Boris Leidner <fatsort(at)formenos.de>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+	This file contains/describes functions for the conversion of unicode strings.
+*/
+
+#include "unicode.h"
+
+#include <string.h>
+#include <assert.h>
+#include "mallocv.h"
+
+// replacement character for unpaired surrogates
+#define REPLACEMENT_CHARACTER 0xfffd
+
+size_t utf16leToUTF8(const u_char *src, u_int32_t n, char *dst, size_t size) {
+/*
+	decode n UTF-16LE code units in src to UTF-8. It stops at the first NUL
+	code unit and writes at most size-1 bytes and a terminating '\0' to dst,
+	a character that doesn't fit is dropped. Unpaired surrogates are replaced
+	by U+FFFD. Returns the length of the UTF-8 string.
+*/
+	assert(src != NULL);
+	assert(dst != NULL);
+	assert(size > 0);
+
+	u_int32_t i=0, u, lo;
+	size_t len=0;
+	u_int64_t w, asciiMask;
+
+	// bits that must be clear in four ASCII code units, in memory order
+	static const u_char asciiMaskBytes[8]={0x80, 0xff, 0x80, 0xff, 0x80, 0xff, 0x80, 0xff};
+	memcpy(&asciiMask, asciiMaskBytes, 8);
+
+	while (i < n) {
+		// fast path: four ASCII code units at once
+		if ((n - i >= 4) && (size - len > 4)) {
+			memcpy(&w, src + i*2, 8);
+			if (((w & asciiMask) == 0) &&
+			    src[i*2] && src[i*2+2] && src[i*2+4] && src[i*2+6]) {
+				dst[len++]=src[i*2];
+				dst[len++]=src[i*2+2];
+				dst[len++]=src[i*2+4];
+				dst[len++]=src[i*2+6];
+				i+=4;
+				continue;
+			}
+		}
+
+		u=src[i*2] | (src[i*2+1] << 8);
+		if (u == 0) break;
+		i++;
+
+		if ((u >= 0xd800) && (u <= 0xdbff) && (i < n)) {
+			lo=src[i*2] | (src[i*2+1] << 8);
+			if ((lo >= 0xdc00) && (lo <= 0xdfff)) {
+				u=0x10000 + ((u - 0xd800) << 10) + (lo - 0xdc00);
+				i++;
+			}
+		}
+		if ((u >= 0xd800) && (u <= 0xdfff)) {
+			u=REPLACEMENT_CHARACTER;
+		}
+
+		if (u < 0x80) {
+			if (size - len < 2) break;
+			dst[len++]=u;
+		} else if (u < 0x800) {
+			if (size - len < 3) break;
+			dst[len++]=0xc0 | (u >> 6);
+			dst[len++]=0x80 | (u & 0x3f);
+		} else if (u < 0x10000) {
+			if (size - len < 4) break;
+			dst[len++]=0xe0 | (u >> 12);
+			dst[len++]=0x80 | ((u >> 6) & 0x3f);
+			dst[len++]=0x80 | (u & 0x3f);
+		} else {
+			if (size - len < 5) break;
+			dst[len++]=0xf0 | (u >> 18);
+			dst[len++]=0x80 | ((u >> 12) & 0x3f);
+			dst[len++]=0x80 | ((u >> 6) & 0x3f);
+			dst[len++]=0x80 | (u & 0x3f);
+		}
+	}
+	dst[len]='\0';
+
+	return len;
+}
@@ -0,0 +1,33 @@
+/*
+	FATSort, utility for sorting FAT directory structures
+	Copyright (C) 2004 Boris Leidner <fatsort(at)formenos.de>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+	This file contains/describes functions for the conversion of unicode strings.
+*/
+
+#ifndef __unicode_h__
+#define __unicode_h__
+
+#include <sys/types.h>
+#include <stddef.h>
+
+// decode n UTF-16LE code units to UTF-8, stops at the first NUL code unit
+size_t utf16leToUTF8(const u_char *src, u_int32_t n, char *dst, size_t size);
+
+#endif // __unicode_h__
@@ -0,0 +1,299 @@
+/*
+	FATSort, utility for sorting FAT directory structures
+	Copyright (C) 2004 Boris Leidner <fatsort(at)formenos.de>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+	This file contains a minimal io_uring submission and completion
+	queue that is driven by raw system calls, so no extra library is needed.
+*/
+
+#include "uring.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/param.h>
+#include "errors.h"
+#include "mallocv.h"
+
+#if defined(__LINUX__)
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#endif
+
+#if defined(__LINUX__) && defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+
+// consecutive failed waits before giving up on transfers in flight
+#define URING_WAIT_RETRIES 1000
+
+struct sURing {
+	int32_t fd;
+	u_int32_t depth;		// transfers in flight at most
+	// submission queue
+	void *sqRing;
+	size_t sqRingSize;
+	u_int32_t *sqHead, *sqTail, *sqMask, *sqArray;
+	struct io_uring_sqe *sqes;
+	size_t sqesSize;
+	// completion queue, shares the mapping of the submission queue on newer kernels
+	void *cqRing;
+	size_t cqRingSize;
+	u_int32_t *cqHead, *cqTail, *cqMask;
+	struct io_uring_cqe *cqes;
+};
+
+static void shutdownURing(struct sURing *ring) {
+/*
+	unmaps the queues and closes the ring. Closing neither waits for nor
+	cancels transfers synchronously, so none may be in flight any more
+*/
+	if ((ring->sqes != NULL) && (ring->sqes != MAP_FAILED)) munmap(ring->sqes, ring->sqesSize);
+	if ((ring->cqRing != NULL) && (ring->cqRing != MAP_FAILED) && (ring->cqRing != ring->sqRing)) {
+		munmap(ring->cqRing, ring->cqRingSize);
+	}
+	if ((ring->sqRing != NULL) && (ring->sqRing != MAP_FAILED)) munmap(ring->sqRing, ring->sqRingSize);
+	ring->sqes=NULL;
+	ring->cqRing=NULL;
+	ring->sqRing=NULL;
+	if (ring->fd != -1) close(ring->fd);
+	ring->fd=-1;
+}
+
+struct sURing *newURing(u_int32_t depth) {
+/*
+	sets up a ring for depth transfers in flight
+*/
+	struct sURing *ring;
+	struct io_uring_params params;
+	int32_t err;
+
+	if ((ring=malloc(sizeof(struct sURing))) == NULL) {
+		return NULL;
+	}
+	memset(ring, 0, sizeof(struct sURing));
+	memset(&params, 0, sizeof(params));
+
+	if ((ring->fd=syscall(__NR_io_uring_setup, depth, &params)) == -1) {
+		err=errno;
+		free(ring);
+		errno=err;
+		return NULL;
+	}
+	ring->depth=MIN(depth, params.sq_entries);
+
+	ring->sqRingSize=params.sq_off.array + params.sq_entries * sizeof(u_int32_t);
+	ring->cqRingSize=params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		ring->sqRingSize=ring->cqRingSize=MAX(ring->sqRingSize, ring->cqRingSize);
+	}
+	ring->sqesSize=params.sq_entries * sizeof(struct io_uring_sqe);
+
+	ring->sqRing=mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		ring->fd, IORING_OFF_SQ_RING);
+	if (ring->sqRing == MAP_FAILED) goto failed;
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		ring->cqRing=ring->sqRing;
+	} else {
+		ring->cqRing=mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			ring->fd, IORING_OFF_CQ_RING);
+		if (ring->cqRing == MAP_FAILED) goto failed;
+	}
+	ring->sqes=mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		ring->fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) goto failed;
+
+	ring->sqHead=(u_int32_t *) ((u_char *) ring->sqRing + params.sq_off.head);
+	ring->sqTail=(u_int32_t *) ((u_char *) ring->sqRing + params.sq_off.tail);
+	ring->sqMask=(u_int32_t *) ((u_char *) ring->sqRing + params.sq_off.ring_mask);
+	ring->sqArray=(u_int32_t *) ((u_char *) ring->sqRing + params.sq_off.array);
+	ring->cqHead=(u_int32_t *) ((u_char *) ring->cqRing + params.cq_off.head);
+	ring->cqTail=(u_int32_t *) ((u_char *) ring->cqRing + params.cq_off.tail);
+	ring->cqMask=(u_int32_t *) ((u_char *) ring->cqRing + params.cq_off.ring_mask);
+	ring->cqes=(struct io_uring_cqe *) ((u_char *) ring->cqRing + params.cq_off.cqes);
+
+	return ring;
+
+failed:
+	err=errno;
+	freeURing(ring);
+	errno=err;
+	return NULL;
+}
+
+static void queueTransfer(struct sURing *ring, int32_t fd, struct sIORequest *req, struct iovec *iov,
+			size_t done, u_int32_t index, u_int32_t write) {
+/*
+	queues the rest of a transfer, the kernel sees it after the next io_uring_enter
+*/
+	u_int32_t tail, slot;
+	struct io_uring_sqe *sqe;
+
+	tail=*ring->sqTail;
+	slot=tail & *ring->sqMask;
+	sqe=&ring->sqes[slot];
+
+	iov->iov_base=(u_char *) req->buf + done;
+	iov->iov_len=req->size - done;
+
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	sqe->opcode=write ? IORING_OP_WRITEV : IORING_OP_READV;
+	sqe->fd=fd;
+	sqe->addr=(u_int64_t) (uintptr_t) iov;
+	sqe->len=1;
+	sqe->off=req->offset + done;
+	sqe->user_data=index;
+
+	ring->sqArray[slot]=slot;
+	__atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+}
+
+int32_t uringTransfer(struct sURing *ring, int32_t fd, struct sIORequest *reqs, u_int32_t count, u_int32_t write) {
+/*
+	transfers all requests with fd, at most depth of them in flight at once.
+	The function returns only after the last transfer completed, so callers
+	see the batch as done in order even though the device may complete it in any order
+*/
+	struct iovec *iov;
+	size_t *done;
+	u_int32_t next=0, inFlight=0, pending, head, tail, index, waitFailed=0;
+	int32_t res, err=0;
+	struct io_uring_cqe *cqe;
+
+	if (count == 0) return 0;
+
+	// one iovec per request, it has to stay valid until the request completed
+	if ((iov=malloc(count * sizeof(struct iovec))) == NULL) {
+		return -1;
+	}
+	if ((done=calloc(count, sizeof(size_t))) == NULL) {
+		free(iov);
+		return -1;
+	}
+
+	while ((inFlight > 0) || (!err && (next < count))) {
+		// keep the queue filled up to its depth
+		while (!err && (next < count) && (inFlight < ring->depth)) {
+			queueTransfer(ring, fd, &reqs[next], &iov[next], 0, next, write);
+			next++;
+			inFlight++;
+		}
+
+		// submit the queued transfers and wait for at least one completion
+		pending=*ring->sqTail - __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+		if (syscall(__NR_io_uring_enter, ring->fd, pending, 1, IORING_ENTER_GETEVENTS, NULL, 0) == -1) {
+			if ((errno != EINTR) && (errno != EAGAIN) && (errno != EBUSY)) {
+				// transfers the kernel did not take are not in flight
+				pending=*ring->sqTail - __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+				if (pending) {
+					__atomic_store_n(ring->sqTail, *ring->sqTail - pending, __ATOMIC_RELEASE);
+					inFlight-=pending;
+				}
+				if (!err) err=errno;
+
+				// the buffers of transfers in flight must not be released before they
+				// completed, so reaping goes on. A ring that cannot be drained leaves
+				// the kernel writing into memory that would be released on return
+				if ((inFlight > 0) && (++waitFailed >= URING_WAIT_RETRIES)) {
+					myerror("Failed to wait for %u transfers in flight!", inFlight);
+					abort();
+				}
+			}
+		} else {
+			waitFailed=0;
+		}
+
+		// reap completions, partial transfers are queued again
+		head=*ring->cqHead;
+		tail=__atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+		while (head != tail) {
+			cqe=&ring->cqes[head & *ring->cqMask];
+			index=cqe->user_data;
+			res=cqe->res;
+			head++;
+
+			if ((res == -EINTR) || (res == -EAGAIN)) {
+				if (!err) {
+					queueTransfer(ring, fd, &reqs[index], &iov[index], done[index], index, write);
+					continue;
+				}
+			} else if (res < 0) {
+				if (!err) err=-res;
+			} else if (res == 0) {
+				// end of file
+				if (!err) err=EIO;
+			} else {
+				done[index]+=res;
+				if ((done[index] < reqs[index].size) && !err) {
+					queueTransfer(ring, fd, &reqs[index], &iov[index], done[index], index, write);
+					continue;
+				}
+			}
+			inFlight--;
+		}
+		__atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+	}
+
+	free(iov);
+	free(done);
+
+	if (err) {
+		errno=err;
+		return -1;
+	}
+
+	return 0;
+}
+
+void freeURing(struct sURing *ring) {
+/*
+	tears down the ring
+*/
+	if (ring == NULL) return;
+
+	shutdownURing(ring);
+	free(ring);
+}
+
+#else
+
+// io_uring is Linux only
+
+struct sURing *newURing(u_int32_t depth) {
+	(void) depth;
+
+	errno=ENOSYS;
+	return NULL;
+}
+
+int32_t uringTransfer(struct sURing *ring, int32_t fd, struct sIORequest *reqs, u_int32_t count, u_int32_t write) {
+	(void) ring; (void) fd; (void) reqs; (void) count; (void) write;
+
+	errno=ENOSYS;
+	return -1;
+}
+
+void freeURing(struct sURing *ring) {
+	(void) ring;
+}
+
+#endif
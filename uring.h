@@ -0,0 +1,46 @@
+/*
+	FATSort, utility for sorting FAT directory structures
+	Copyright (C) 2004 Boris Leidner <fatsort(at)formenos.de>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+	This file contains/describes a minimal io_uring submission and completion
+	queue that is driven by raw system calls, so no extra library is needed.
+*/
+
+#ifndef __uring_h__
+#define __uring_h__
+
+#include <sys/types.h>
+#include "platform.h"
+#include "fileio.h"
+
+struct sURing;
+
+// sets up a ring for depth transfers in flight,
+// returns NULL with errno set if io_uring is not available
+struct sURing *newURing(u_int32_t depth);
+
+// transfers all requests with fd, at most depth of them in flight at once;
+// partial transfers are resubmitted, returns 0 once all requests
+// completed in full and -1 with errno set otherwise
+int32_t uringTransfer(struct sURing *ring, int32_t fd, struct sIORequest *reqs, u_int32_t count, u_int32_t write);
+
+// tears down the ring
+void freeURing(struct sURing *ring);
+
+#endif // __uring_h__